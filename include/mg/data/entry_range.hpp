@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+namespace mg::data {
+
+// Where an archive entry's data lies, in bytes from the start of the archive
+// data. Offsets and sizes come from 32-bit header fields, and so must each be
+// below 2^62.
+struct EntryRange {
+  uint64_t offset;
+  uint64_t size;
+};
+
+// Two entries whose data share bytes. `first` starts at or before `second`.
+struct EntryOverlap {
+  uint32_t first;
+  uint32_t second;
+};
+
+// Index of the first range that does not lie within `data_size` bytes, or -1
+// if they all do. Ranges are checked two at a time, without branching, and
+// only searched one by one if any of them are out of bounds.
+ssize_t entry_range_out_of_bounds(const std::vector<EntryRange> &ranges,
+                                  uint64_t data_size);
+
+// Find entries whose data overlap. Each entry that overlaps an entry starting
+// before it is recorded once, against the one of those that reaches furthest,
+// so the output never holds more pairs than there are entries. Empty entries
+// overlap nothing.
+void entry_range_overlaps(const std::vector<EntryRange> &ranges,
+                          std::vector<EntryOverlap> &out);
+
+// Check every range lies within `data_size` bytes, and record any overlaps.
+// Archive views validate their entry table with this once at parse time, so
+// that their entry accessors can slice the data without further checks.
+// Returns false, naming the first bad entry of the `kind` archive, if any
+// range is out of bounds.
+bool entry_ranges_validate(const char *kind,
+                           const std::vector<EntryRange> &ranges,
+                           uint64_t data_size,
+                           std::vector<EntryOverlap> &overlaps);
+
+} // namespace mg::data
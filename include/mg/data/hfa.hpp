@@ -7,6 +7,7 @@
 #include <string_view>
 #include <vector>
 
+#include <mg/data/entry_range.hpp>
 #include <mg/util/fs.hpp>
 
 namespace mg::data {
@@ -48,28 +49,41 @@ public:
   static std::unique_ptr<MappedHfa>
   parse(std::shared_ptr<mg::fs::MappedFile> backing_data);
 
+  // Parse an HFA that lives inside some other buffer. If a backing file is
+  // given it is held for the lifetime of the view, otherwise the caller must
+  // keep `data` alive.
+  static std::unique_ptr<MappedHfa>
+  parse(std::string_view data,
+        std::shared_ptr<mg::fs::MappedFile> backing_data = nullptr);
+
   const std::vector<Hfa::PackedEntryHeader> &entries() const {
     return _entries;
   }
 
+  // Entry ranges are bounds checked once at parse time
   const std::string_view entry_data(int index) const {
     const auto &entry = _entries.at(index);
     const size_t header_size_bytes =
         sizeof(Hfa::FileHeader) +
         sizeof(Hfa::PackedEntryHeader) * _entries.size();
     const size_t offset_bytes = header_size_bytes + entry.offset;
-    return std::string_view(
-        reinterpret_cast<const char *>(_backing_data->data()) + offset_bytes,
-        entry.size);
+    return std::string_view(_data.data() + offset_bytes, entry.size);
   }
 
+  // Entries whose data share bytes
+  const std::vector<EntryOverlap> &overlaps() const { return _overlaps; }
+
 private:
   MappedHfa(std::shared_ptr<mg::fs::MappedFile> backing_data,
-            std::vector<Hfa::PackedEntryHeader> entries)
-      : _backing_data(backing_data), _entries(entries) {}
+            std::string_view data, std::vector<Hfa::PackedEntryHeader> entries,
+            std::vector<EntryOverlap> overlaps)
+      : _backing_data(backing_data), _data(data), _entries(entries),
+        _overlaps(overlaps) {}
 
   std::shared_ptr<mg::fs::MappedFile> _backing_data;
+  std::string_view _data;
   std::vector<Hfa::PackedEntryHeader> _entries;
+  std::vector<EntryOverlap> _overlaps;
 };
 
 bool hfa_read(const std::string &hed, const std::string &hfa, Hfa &out);
@@ -7,6 +7,7 @@
 #include <string_view>
 #include <vector>
 
+#include <mg/data/entry_range.hpp>
 #include <mg/util/fs.hpp>
 
 namespace mg::data {
@@ -63,28 +64,49 @@ public:
   parse(const std::string &header,
         std::shared_ptr<mg::fs::MappedFile> backing_data);
 
+  // Parse an MRG whose data lives in some other buffer. If a backing file is
+  // given it is held for the lifetime of the view, otherwise the caller must
+  // keep `data` alive.
+  static std::unique_ptr<MappedMrg>
+  parse(const std::string &header, std::string_view data,
+        std::shared_ptr<mg::fs::MappedFile> backing_data = nullptr);
+
   const std::vector<Mrg::PackedEntryHeader> &entries() const {
     return _entries;
   }
+
+  // Entry ranges are bounds checked once at parse time
   const std::string_view entry_data(int index) const {
     const auto &entry = _entries.at(index);
     const size_t offset_bytes = (size_t)entry.offset * (size_t)Mrg::SECTOR_SIZE;
     const unsigned size_bytes = entry.size_sectors * Mrg::SECTOR_SIZE;
-    return std::string_view(
-        reinterpret_cast<const char *>(_backing_data->data()) + offset_bytes,
-        size_bytes);
+    return std::string_view(_data.data() + offset_bytes, size_bytes);
   }
 
+  // Entries whose data share sectors
+  const std::vector<EntryOverlap> &overlaps() const { return _overlaps; }
+
 private:
   MappedMrg(std::shared_ptr<mg::fs::MappedFile> backing_data,
-            std::vector<Mrg::PackedEntryHeader> entries)
-      : _backing_data(backing_data), _entries(entries) {}
+            std::string_view data, std::vector<Mrg::PackedEntryHeader> entries,
+            std::vector<EntryOverlap> overlaps)
+      : _backing_data(backing_data), _data(data), _entries(entries),
+        _overlaps(overlaps) {}
 
   std::shared_ptr<mg::fs::MappedFile> _backing_data;
+  std::string_view _data;
   std::vector<Mrg::PackedEntryHeader> _entries;
+  std::vector<EntryOverlap> _overlaps;
 };
 
 bool mrg_read(const std::string &hed, const std::string &mrg, Mrg &out);
 bool mrg_write(const Mrg &in, std::string &hed, std::string &mrg);
 
+// Size in bytes of the MRG data that mrg_write will produce
+uint64_t mrg_data_size(const Mrg &in);
+
+// Serialize the MRG data into a caller-provided buffer of exactly
+// mrg_data_size() bytes, such as a MappedFile::create() mapping
+bool mrg_write(const Mrg &in, std::string &hed, uint8_t *mrg);
+
 } // namespace mg::data
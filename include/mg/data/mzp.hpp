@@ -2,9 +2,14 @@
 
 #include <stdint.h>
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include <mg/data/entry_range.hpp>
+#include <mg/util/fs.hpp>
+
 namespace mg::data {
 
 struct Mzp {
@@ -42,7 +47,7 @@ struct Mzp {
     // Update the data size sectors/bytes based on absolute size
     void set_data_size(uint32_t size);
 
-    void print();
+    void print() const;
 
     uint32_t entry_data_size() const {
       // The `size` field is the raw 16 low 16 bits of the full size of the
@@ -84,6 +89,83 @@ struct Mzp {
   }
 };
 
+struct MappedMzp {
+public:
+  static std::unique_ptr<MappedMzp>
+  parse(std::shared_ptr<mg::fs::MappedFile> backing_data);
+
+  // Parse an MZP that lives inside some other buffer, such as an entry of a
+  // MappedMrg. If a backing file is given it is held for the lifetime of the
+  // view, otherwise the caller must keep `data` alive.
+  static std::unique_ptr<MappedMzp>
+  parse(std::string_view data,
+        std::shared_ptr<mg::fs::MappedFile> backing_data = nullptr);
+
+  const Mzp::MzpArchiveHeader &header() const { return _header; }
+  const std::vector<Mzp::MzpArchiveEntry> &entries() const { return _entries; }
+
+  // Offset of an entry's data relative to the start of the archive
+  uint32_t entry_start_offset(int index) const {
+    return _data_start_offset + _entries.at(index).data_offset_relative();
+  }
+
+  // Entry ranges are bounds checked once at parse time
+  const std::string_view entry_data(int index) const {
+    const auto &entry = _entries.at(index);
+    return std::string_view(_data.data() + _data_start_offset +
+                                entry.data_offset_relative(),
+                            entry.entry_data_size());
+  }
+
+  // Entries whose data share bytes
+  const std::vector<EntryOverlap> &overlaps() const { return _overlaps; }
+
+private:
+  MappedMzp(std::shared_ptr<mg::fs::MappedFile> backing_data,
+            std::string_view data, Mzp::MzpArchiveHeader header,
+            std::vector<Mzp::MzpArchiveEntry> entries,
+            std::vector<EntryOverlap> overlaps)
+      : _backing_data(backing_data), _data(data), _header(header),
+        _entries(entries), _overlaps(overlaps),
+        _data_start_offset(sizeof(Mzp::MzpArchiveHeader) +
+                           sizeof(Mzp::MzpArchiveEntry) * _entries.size()) {}
+
+  std::shared_ptr<mg::fs::MappedFile> _backing_data;
+  std::string_view _data;
+  Mzp::MzpArchiveHeader _header;
+  std::vector<Mzp::MzpArchiveEntry> _entries;
+  std::vector<EntryOverlap> _overlaps;
+  uint32_t _data_start_offset;
+};
+
+// Lays out an MZP archive in a single pass as entries are added. Entry data is
+// borrowed, not copied, so it must outlive the writer.
+class MzpWriter {
+public:
+  void add_entry(std::string_view data);
+
+  // Total serialized size of the archive in bytes
+  size_t size() const { return data_start_offset() + _data_size; }
+
+  // Serialize into a caller-provided buffer of exactly size() bytes
+  void write(uint8_t *out) const;
+
+  // Serialize to a file descriptor with gathered writes
+  bool write(int fd) const;
+
+private:
+  size_t data_start_offset() const {
+    return sizeof(Mzp::MzpArchiveHeader) +
+           sizeof(Mzp::MzpArchiveEntry) * _entry_headers.size();
+  }
+  Mzp::MzpArchiveHeader file_header() const;
+
+  // Entry headers are kept in file order, ready to emit
+  std::vector<Mzp::MzpArchiveEntry> _entry_headers;
+  std::vector<std::string_view> _entry_data;
+  size_t _data_size = 0;
+};
+
 bool mzp_read(const std::string &data, Mzp &out);
 void mzp_write(const Mzp &mzp, std::string &out);
 
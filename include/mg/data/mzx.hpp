@@ -1,8 +1,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 #include <mg/util/endian.hpp>
+#include <mg/util/progress.hpp>
 
 namespace mg::data {
 
@@ -24,8 +26,30 @@ struct __attribute__((__packed__)) MzxHeader {
   }
 };
 
-bool mzx_decompress(const std::string &compressed, std::string &out,
-                    bool invert = true);
-bool mzx_compress(const std::string &raw, std::string &out, bool invert = true);
+// If a progress tracker is given, the number of compressed bytes consumed is
+// published to it periodically, and decompression fails once it is
+// cancelled
+bool mzx_decompress(const std::string_view &compressed, std::string &out,
+                    bool invert = true,
+                    mg::util::Progress *progress = nullptr);
+bool mzx_compress(const std::string_view &raw, std::string &out,
+                  bool invert = true);
+
+// Read the decompressed size from an MZX header, validating the magic
+bool mzx_decompressed_size(const std::string_view &compressed, uint32_t &out);
+
+// Decompress into a caller-provided buffer of at least
+// mzx_decompressed_size() bytes
+bool mzx_decompress(const std::string_view &compressed, uint8_t *out,
+                    size_t out_size, bool invert = true,
+                    mg::util::Progress *progress = nullptr);
+
+// Worst case compressed size for raw_size bytes of input
+size_t mzx_compress_bound(size_t raw_size);
+
+// Compress into a caller-provided buffer of out_size bytes, which must be at
+// least mzx_compress_bound(). On success out_size is set to the bytes used.
+bool mzx_compress(const std::string_view &raw, uint8_t *out, size_t &out_size,
+                  bool invert = true);
 
 } // namespace mg::data
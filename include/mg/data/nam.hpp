@@ -2,9 +2,13 @@
 
 #include <stdint.h>
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include <mg/util/fs.hpp>
+
 namespace mg::data {
 
 struct Nam {
@@ -14,6 +18,29 @@ struct Nam {
   std::vector<std::string> names;
 };
 
+// Zero-copy view of a NAM, with each name pointing into the backing data
+struct NamView {
+public:
+  static std::unique_ptr<NamView>
+  parse(std::shared_ptr<mg::fs::MappedFile> backing_data);
+
+  // Parse NAM data held elsewhere. If a backing file is given it is held for
+  // the lifetime of the view, otherwise the caller must keep `data` alive.
+  static std::unique_ptr<NamView>
+  parse(std::string_view data,
+        std::shared_ptr<mg::fs::MappedFile> backing_data = nullptr);
+
+  const std::vector<std::string_view> &names() const { return _names; }
+
+private:
+  NamView(std::shared_ptr<mg::fs::MappedFile> backing_data,
+          std::vector<std::string_view> names)
+      : _backing_data(backing_data), _names(std::move(names)) {}
+
+  std::shared_ptr<mg::fs::MappedFile> _backing_data;
+  std::vector<std::string_view> _names;
+};
+
 bool nam_read(const std::string &data, Nam &out);
 bool nam_write(const Nam &in, std::string &out);
 
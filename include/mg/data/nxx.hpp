@@ -6,6 +6,8 @@
 #include <string_view>
 #include <vector>
 
+#include <mg/util/progress.hpp>
+
 namespace mg::data {
 
 // Handler for both NXGX and NXCX file formats
@@ -23,11 +25,30 @@ static_assert(sizeof(Nxx) == 16);
 bool is_nxx_data(const std::string_view &data);
 bool extract_nxx_header(const std::string_view &data, Nxx &out);
 
-bool nxx_decompress(const std::string_view &in, std::string &out);
+// If a progress tracker is given, the number of compressed bytes consumed is
+// published to it periodically, and decompression fails once it is
+// cancelled
+bool nxx_decompress(const std::string_view &in, std::string &out,
+                    mg::util::Progress *progress = nullptr);
 bool nxgx_decompress(const Nxx &header, const uint8_t *data, std::string &out);
 bool nxcx_decompress(const Nxx &header, const uint8_t *data, std::string &out);
 
+// Decompress into a caller-provided buffer of at least header.size bytes
+bool nxx_decompress(const std::string_view &in, uint8_t *out, size_t out_size,
+                    mg::util::Progress *progress = nullptr);
+bool nxgx_decompress(const Nxx &header, const uint8_t *data, uint8_t *out,
+                     size_t out_size, mg::util::Progress *progress = nullptr);
+bool nxcx_decompress(const Nxx &header, const uint8_t *data, uint8_t *out,
+                     size_t out_size, mg::util::Progress *progress = nullptr);
+
 bool nxgx_compress(const std::string_view &in, std::string &out);
 bool nxcx_compress(const std::string_view &in, std::string &out);
 
+// Worst case NXGX output size for in_size bytes of input
+size_t nxgx_compress_bound(size_t in_size);
+
+// Compress into a caller-provided buffer of out_size bytes, which must be at
+// least nxgx_compress_bound(). On success out_size is set to the bytes used.
+bool nxgx_compress(const std::string_view &in, uint8_t *out, size_t &out_size);
+
 } // namespace mg::data
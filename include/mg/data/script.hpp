@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <mg/data/walk.hpp>
+
+namespace mg::data {
+
+// One command from a script's command stream (see doc/script_commands.md).
+// All fields are views into the script.
+struct ScriptCommand {
+  // Command name, including the leading underscore: "_STCH", or for the
+  // addressed _Z commands just the prefix, e.g. "_ZM"
+  std::string_view name;
+  // Hex address following a _Z command name ("b961f"), otherwise empty
+  std::string_view address;
+  // Raw text between the parentheses
+  std::string_view args;
+  // Byte offset of the command in the script
+  size_t offset;
+
+  // Comma separated argument by index, empty if there are not that many
+  std::string_view arg(unsigned index) const;
+};
+
+// Walks the commands in a script without copying anything. Bytes between
+// commands (line breaks, stray text) are skipped.
+class ScriptTokenizer {
+public:
+  explicit ScriptTokenizer(const std::string_view &script) : _script(script) {}
+
+  // Read the next command. Returns false at the end of the script.
+  bool next(ScriptCommand &out);
+
+private:
+  std::string_view _script;
+  size_t _pos = 0;
+};
+
+enum AssetKind {
+  ASSET_IMAGE,
+  ASSET_SE,
+  ASSET_VOICE,
+};
+
+const char *asset_kind_name(AssetKind kind);
+
+// An asset loaded by a script command
+struct AssetRef {
+  AssetKind kind;
+  std::string name;
+  uint32_t offset;
+};
+
+// A _PGST page marker, and its (relative) page argument
+struct PageMark {
+  uint32_t offset;
+  int32_t page;
+};
+
+struct SceneInfo {
+  std::string path;
+  std::vector<AssetRef> assets;
+  std::vector<PageMark> pages;
+};
+
+// Asset references and page boundaries across many scripts, with an inverted
+// index from asset name to the scenes that use it
+class ScriptIndex {
+public:
+  // A single use of an asset: a scene and an index into its assets
+  struct AssetUse {
+    uint32_t scene;
+    uint32_t asset;
+  };
+
+  // Scan a script and add it, if it holds any commands. Returns whether it
+  // did. Safe to call from several threads at once.
+  bool add_scene(const std::string &path, const std::string_view &script);
+
+  // Sort the scenes by path and build the inverted index. Must be called
+  // after the last add_scene and before any lookups.
+  void finalize();
+
+  const std::vector<SceneInfo> &scenes() const { return _scenes; }
+  const SceneInfo *find_scene(const std::string_view &path) const;
+
+  // Every use of an asset, in scene then offset order
+  std::vector<AssetUse> find_asset(const std::string_view &name) const;
+
+  // Every use of every asset, ordered by asset name
+  const std::vector<AssetUse> &asset_uses() const { return _asset_uses; }
+
+  const AssetRef &asset(const AssetUse &use) const {
+    return _scenes[use.scene].assets[use.asset];
+  }
+
+private:
+  std::mutex _mutex;
+  std::vector<SceneInfo> _scenes;
+  std::vector<AssetUse> _asset_uses;
+};
+
+// Walk an archive (as with walk()) in parallel, and index every payload that
+// contains script commands
+bool script_index_build(const char *path, ScriptIndex &out,
+                        const WalkOptions &options = WalkOptions());
+
+} // namespace mg::data
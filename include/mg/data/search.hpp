@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <mg/data/walk.hpp>
+
+namespace mg::data {
+
+struct SearchPattern {
+  // Shown alongside matches
+  std::string label;
+  std::string bytes;
+};
+
+// Add patterns matching `text` (UTF-8) as both UTF-8 and Shift-JIS. The
+// Shift-JIS form is skipped if it is identical, e.g. for plain ASCII, or if
+// the text cannot be encoded as Shift-JIS. Returns false if no pattern could
+// be made, i.e. the text is empty.
+bool search_patterns_for_text(const std::string &text,
+                              std::vector<SearchPattern> &out);
+
+// Finds every occurrence of any of a set of byte patterns. Candidate
+// positions are found 16 at a time by matching the first and last byte of
+// each pattern, and only those are compared in full.
+class MultiSearcher {
+public:
+  // Patterns must not be empty
+  explicit MultiSearcher(std::vector<SearchPattern> patterns);
+
+  const std::vector<SearchPattern> &patterns() const { return _patterns; }
+
+  // Call `found` with the offset and pattern index of every match
+  void scan(const std::string_view &data,
+            const std::function<void(size_t offset, unsigned pattern)>
+                &found) const;
+
+private:
+  std::vector<SearchPattern> _patterns;
+  size_t _max_length = 0;
+};
+
+struct SearchHit {
+  // Payload path, as for walk()
+  std::string path;
+  // Offset of the match within the (decoded) payload
+  uint64_t offset;
+  unsigned pattern;
+};
+
+struct SearchStats {
+  uint64_t payloads = 0;
+  uint64_t bytes = 0;
+  uint64_t hits = 0;
+};
+
+// Search every leaf payload of an archive, as found by walk(). Compressed
+// entries are decoded on the fly and searched in their decoded form, unless
+// decompression is disabled in which case their raw bytes are searched.
+// Matches are reported from pool threads as soon as they are found. Returns
+// false if the archive could not be opened or the search was cancelled.
+bool search_archive(const char *path, const MultiSearcher &searcher,
+                    const std::function<void(const SearchHit &)> &found,
+                    const WalkOptions &options = WalkOptions(),
+                    SearchStats *stats = nullptr);
+
+} // namespace mg::data
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mg::data {
+
+struct StringTable {
+
+  // Script text is stored as pairs of MZP entries: an offset table, and the
+  // string data it indexes.
+  // Offsets are big-endian u32s. Each points at a string that runs until
+  // \r\n. The table is closed by two offsets pointing at the end of the
+  // string data, followed by 12 bytes of 0xFF.
+
+  static const uint32_t END_OF_TABLE = 0xFFFFFFFF;
+  static const unsigned END_OF_TABLE_COUNT = 3;
+  static const unsigned END_OF_DATA_COUNT = 2;
+};
+
+// Byte-swap a run of u32s between big-endian and host order, in place
+void string_table_swap_offsets(uint32_t *offsets, size_t count);
+
+// Decode an offset table to host order, up to the first END_OF_TABLE
+void string_table_read_offsets(const std::string_view &offset_table,
+                               std::vector<uint32_t> &out);
+
+// Read every string in a table pair, as views into `string_data`. Offsets
+// that point at the end of the data (the end markers) are skipped. Offsets
+// past the end, or whose string is not terminated, are skipped with a
+// warning.
+void string_table_read(const std::string_view &offset_table,
+                       const std::string_view &string_data,
+                       std::vector<std::string_view> &out);
+
+// Serialize strings to a new table pair, re-adding the \r\n terminators and
+// end markers
+void string_table_write(const std::vector<std::string_view> &strings,
+                        std::string &offset_table, std::string &string_data);
+
+} // namespace mg::data
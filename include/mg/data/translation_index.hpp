@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <mg/util/fs.hpp>
+
+namespace mg::data {
+
+struct TranslationIndex {
+
+  // Precompiled form of the JSON translation DB, laid out so that it can be
+  // mapped and queried without parsing.
+  // All integer fields are little-endian
+  //
+  // File header
+  // Language names (language_count * 8 bytes, nul padded)
+  // Entries (entry_count), sorted by digest. Each entry is the raw SHA-256 of
+  //   the original line followed by one StringRef per language
+  // String data (string_data_size bytes)
+
+  static constexpr const char *FILE_MAGIC = "MGTLIDX1";
+  static const unsigned DIGEST_SIZE = 32;
+  static const unsigned LANGUAGE_NAME_SIZE = 8;
+
+  struct __attribute__((__packed__)) FileHeader {
+    char magic[8];
+    uint32_t language_count;
+    uint32_t entry_count;
+    uint64_t string_data_size;
+    void to_host_order();
+    void to_file_order();
+  };
+  static_assert(sizeof(FileHeader) == 24);
+
+  // Location of one string in the string data
+  struct __attribute__((__packed__)) StringRef {
+    uint32_t offset;
+    uint32_t size;
+  };
+  static_assert(sizeof(StringRef) == 8);
+
+  // Size of one entry in the entry table
+  static size_t entry_size(uint32_t language_count) {
+    return DIGEST_SIZE + sizeof(StringRef) * language_count;
+  }
+};
+
+// One line of the DB, as input to the index writer
+struct TranslationRecord {
+  // Raw SHA-256 of the original line
+  std::string_view digest;
+  // Text per language, in the same order as the language list. Empty strings
+  // are treated as missing.
+  const std::string_view *text;
+};
+
+struct MappedTranslationIndex {
+public:
+  static std::unique_ptr<MappedTranslationIndex>
+  parse(std::shared_ptr<mg::fs::MappedFile> backing_data);
+
+  // Parse an index held in memory. If a backing file is given it is held for
+  // the lifetime of the view, otherwise the caller must keep `data` alive.
+  static std::unique_ptr<MappedTranslationIndex>
+  parse(std::string_view data,
+        std::shared_ptr<mg::fs::MappedFile> backing_data = nullptr);
+
+  const std::vector<std::string> &languages() const { return _languages; }
+  uint32_t size() const { return _entry_count; }
+
+  // Index of a language in the language list, or -1 if not present
+  int language_index(const std::string_view &language) const;
+
+  // Find the text for a line by its raw digest. Returns false if the digest
+  // is not in the index, or has no text for this language.
+  bool find(const std::string_view &digest, unsigned language,
+            std::string_view &out) const;
+
+private:
+  MappedTranslationIndex(std::shared_ptr<mg::fs::MappedFile> backing_data,
+                         std::vector<std::string> languages,
+                         const uint8_t *entries, uint32_t entry_count,
+                         std::string_view string_data)
+      : _backing_data(backing_data), _languages(languages), _entries(entries),
+        _entry_count(entry_count),
+        _entry_size(TranslationIndex::entry_size(_languages.size())),
+        _string_data(string_data) {}
+
+  std::shared_ptr<mg::fs::MappedFile> _backing_data;
+  std::vector<std::string> _languages;
+  const uint8_t *_entries;
+  uint32_t _entry_count;
+  size_t _entry_size;
+  std::string_view _string_data;
+};
+
+// Serialize an index. Records are sorted by digest in place; where a digest
+// appears more than once the first record is kept.
+bool translation_index_write(const std::vector<std::string> &languages,
+                             std::vector<TranslationRecord> &records,
+                             std::string &out);
+
+// Compile the JSON translation DB ({"script_text_by_hash": {hex: {lang:
+// text}}}) to an index. DBs of exactly that shape go through a dedicated
+// parser that works in place, anything else through nlohmann::json.
+bool translation_index_compile_json(const std::string_view &json,
+                                    std::string &out);
+
+} // namespace mg::data
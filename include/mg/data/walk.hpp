@@ -0,0 +1,52 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include <mg/util/progress.hpp>
+
+namespace mg::data {
+
+enum Format {
+  FORMAT_UNKNOWN,
+  FORMAT_MRG,
+  FORMAT_MZP,
+  FORMAT_MZX,
+  FORMAT_NXGX,
+  FORMAT_NXCX,
+  FORMAT_HFA,
+};
+
+const char *format_name(Format format);
+
+// Guess the format of a payload from its magic. MRG data has no magic (the
+// layout lives in the HED) so is never returned here.
+Format sniff_format(const std::string_view &data);
+
+struct WalkOptions {
+  // Worker threads to visit on, 0 for hardware concurrency
+  unsigned thread_count = 0;
+  // Do not descend into containers deeper than this
+  unsigned max_depth = 16;
+  // Decompress MZX / NXX payloads and walk their contents
+  bool decompress = true;
+  // If set, counts the payloads visited. Once cancelled, no further payloads
+  // are visited.
+  mg::util::Progress *progress = nullptr;
+};
+
+// Called for every payload, containers included. Paths are the root path
+// followed by one '/'-separated component per level of nesting. Calls are made
+// concurrently from pool threads, and `data` is only valid for the duration
+// of the call.
+using WalkVisitor = std::function<void(const std::string &path, Format format,
+                                       const std::string_view &data)>;
+
+// Recursively walk the archive at `path`. If `path` is the basename of (or
+// path to) an MRG with a sibling HED, it is walked as an MRG, with names from
+// the NAM if present. Anything else is mapped and sniffed.
+bool walk(const char *path, const WalkVisitor &visitor,
+          const WalkOptions &options = WalkOptions());
+
+} // namespace mg::data
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string.h>
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace mg::util {
+
+// Bump allocator for many small allocations that share a lifetime. Nothing is
+// freed until the arena itself is destroyed.
+class Arena {
+public:
+  explicit Arena(size_t block_size = 1024 * 1024) : _block_size(block_size) {}
+
+  char *allocate(size_t size) {
+    if (size > _remaining) {
+      // Oversized requests get a block of their own, so that the current
+      // block can keep being used
+      if (size > _block_size / 4) {
+        _blocks.emplace_back(new char[size]);
+        return _blocks.back().get();
+      }
+      _blocks.emplace_back(new char[_block_size]);
+      _next = _blocks.back().get();
+      _remaining = _block_size;
+    }
+    char *ret = _next;
+    _next += size;
+    _remaining -= size;
+    return ret;
+  }
+
+  std::string_view copy(const std::string_view &data) {
+    char *ret = allocate(data.size());
+    memcpy(ret, data.data(), data.size());
+    return std::string_view(ret, data.size());
+  }
+
+private:
+  Arena(const Arena &other) = delete;
+  Arena &operator=(const Arena &other) = delete;
+
+  const size_t _block_size;
+  std::vector<std::unique_ptr<char[]>> _blocks;
+  char *_next = nullptr;
+  size_t _remaining = 0;
+};
+
+} // namespace mg::util
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace mg::fs {
+
+// Writes many whole files while keeping as few syscalls as possible on the
+// calling thread. Where the kernel allows it, each file is an io_uring chain
+// of openat / write / close against a direct descriptor, with many chains in
+// flight at once. Otherwise the files are written from a thread pool.
+//
+// Unlike FileWriter, files are written in place rather than through a
+// temporary.
+class BatchWriter {
+public:
+  // Queue depth is the maximum number of files in flight at once
+  static std::unique_ptr<BatchWriter> create(unsigned queue_depth = 64);
+  virtual ~BatchWriter() {}
+
+  // Queue a file to be written. The data is borrowed and must stay valid until
+  // flush() returns. May block while earlier files complete.
+  virtual void write_file(const std::string &path,
+                          const std::string_view &data) = 0;
+
+  // Wait for every queued file. Returns false if any of them failed, with
+  // the reason reported on stderr.
+  virtual bool flush() = 0;
+
+  // Name of the backend in use, for diagnostics
+  virtual const char *backend() const = 0;
+};
+
+} // namespace mg::fs
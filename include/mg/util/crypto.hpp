@@ -1,14 +1,96 @@
 #pragma once
 
+#include <openssl/evp.h>
 #include <openssl/sha.h>
 
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <mg.hpp>
+#include <mg/util/thread_pool.hpp>
+#include <mg/util/trace.hpp>
+
 namespace mg::util {
 
-std::string sha256(const std::string &data) {
-  uint8_t digest[SHA256_DIGEST_LENGTH];
-  SHA256(reinterpret_cast<const uint8_t *>(data.data()), data.size(), digest);
-  return std::string{reinterpret_cast<const char *>(digest),
-                     SHA256_DIGEST_LENGTH};
+// Hash the concatenation of `parts` into `out` (SHA256_DIGEST_LENGTH bytes).
+// Goes through EVP so that the SHA-NI / AVX2 implementations are used where
+// the CPU has them, and reuses a context per thread to avoid an allocation
+// per call.
+inline void sha256(std::initializer_list<std::string_view> parts,
+                   uint8_t *out) {
+  thread_local std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(
+      EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+  ASSERT(ctx != nullptr);
+  ASSERT(EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr) == 1);
+  for (auto &part : parts) {
+    ASSERT(EVP_DigestUpdate(ctx.get(), part.data(), part.size()) == 1);
+  }
+  ASSERT(EVP_DigestFinal_ex(ctx.get(), out, nullptr) == 1);
+}
+
+inline void sha256(const std::string_view &data, uint8_t *out) {
+  sha256({data}, out);
+}
+
+inline std::string sha256(const std::string_view &data) {
+  std::string ret;
+  ret.resize(SHA256_DIGEST_LENGTH);
+  sha256(data, reinterpret_cast<uint8_t *>(&ret[0]));
+  return ret;
+}
+
+// Raw digests for a batch of inputs, stored back to back
+struct Sha256Digests {
+  std::string data;
+
+  size_t size() const { return data.size() / SHA256_DIGEST_LENGTH; }
+  std::string_view operator[](size_t index) const {
+    return std::string_view(data).substr(index * SHA256_DIGEST_LENGTH,
+                                         SHA256_DIGEST_LENGTH);
+  }
+};
+
+// Hash a batch of inputs, split into chunks across a pool. OpenSSL has no
+// public multi-buffer SHA-256, so each line is still hashed on its own, but
+// many lines are in flight at once. If no pool is given, or the caller is
+// itself a pool task that must not block on others, pass null to hash on the
+// calling thread.
+inline Sha256Digests sha256_many(const std::vector<std::string_view> &inputs,
+                                 ThreadPool *pool) {
+  MG_TRACE_SCOPE(TRACE_HASH, "sha256_many");
+  // Lines are short, so batch enough of them per task to cover the overhead
+  static const size_t CHUNK_SIZE = 1024;
+
+  Sha256Digests ret;
+  ret.data.resize(inputs.size() * SHA256_DIGEST_LENGTH);
+  uint8_t *out = reinterpret_cast<uint8_t *>(&ret.data[0]);
+  auto hash_range = [&inputs, out](size_t start, size_t end) {
+    for (size_t i = start; i < end; i++) {
+      sha256(inputs[i], out + i * SHA256_DIGEST_LENGTH);
+    }
+  };
+
+  // Small batches are not worth handing off
+  if (pool == nullptr || inputs.size() <= CHUNK_SIZE) {
+    hash_range(0, inputs.size());
+    return ret;
+  }
+
+  std::vector<std::future<void>> chunks;
+  for (size_t start = 0; start < inputs.size(); start += CHUNK_SIZE) {
+    const size_t end = std::min(start + CHUNK_SIZE, inputs.size());
+    chunks.emplace_back(
+        pool->async([&hash_range, start, end]() { hash_range(start, end); }));
+  }
+  for (auto &chunk : chunks) {
+    chunk.get();
+  }
+
+  return ret;
 }
 
 } // namespace mg::util
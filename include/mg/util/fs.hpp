@@ -5,6 +5,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <memory>
@@ -16,6 +17,12 @@ namespace mg::fs {
 class MappedFile {
 public:
   static std::unique_ptr<MappedFile> open(const char *filename);
+
+  // Create a new writable mapping of `size` bytes. Like FileWriter, the data
+  // is built in a temporary that only replaces `path` once finalize()
+  // succeeds. Special files such as /dev/stdout are backed by anonymous
+  // memory and written out on finalize().
+  static std::unique_ptr<MappedFile> create(const char *path, size_t size);
   ~MappedFile();
 
 public:
@@ -25,17 +32,90 @@ public:
     return std::string_view(reinterpret_cast<const char *>(_data), _size);
   }
 
+  // Only valid for mappings from create()
+  uint8_t *mutable_data() { return const_cast<uint8_t *>(_data); }
+
+  // Flush dirty pages of a created mapping to the file
+  bool sync();
+
+  // Flush, trim the file to `final_size` bytes (which may be less than the
+  // mapped size, e.g. after compressing into a worst case sized buffer) and
+  // move it into place. Only the first `final_size` bytes of the mapping
+  // remain accessible afterwards.
+  bool finalize(size_t final_size);
+  bool finalize() { return finalize(_size); }
+
 private:
   MappedFile(const uint8_t *data, ssize_t size) : _data(data), _size(size) {}
+  MappedFile(const uint8_t *data, ssize_t size, int fd, const std::string &path,
+             const std::string &temp_path)
+      : _data(data), _size(size), _fd(fd), _path(path), _temp_path(temp_path),
+        _writable(true) {}
   MappedFile(const MappedFile &other) = delete;
   MappedFile &operator=(const MappedFile &other) = delete;
 
   const uint8_t *const _data;
   const ssize_t _size;
+
+  // Created mappings only. An fd of -1 means anonymous memory destined for a
+  // special file.
+  int _fd = -1;
+  const std::string _path;
+  const std::string _temp_path;
+  const bool _writable = false;
+  bool _finalized = false;
+};
+
+// Writes a file via a temporary in the same directory, which is renamed over
+// the destination on commit(). A crash or error part way through never leaves
+// a torn file at `path`. Special files such as /dev/stdout are written
+// directly.
+class FileWriter {
+public:
+  // If the final size is known, pass it to preallocate the file
+  static std::unique_ptr<FileWriter> open(const char *path,
+                                          uint64_t expected_size = 0);
+  // Discards the output if it was never committed
+  ~FileWriter();
+
+  // Append data. Small writes are coalesced into large blocks.
+  bool write(const std::string_view &data);
+
+  // Write out any buffered data. Must be called before writing to fd()
+  // directly.
+  bool flush();
+  int fd() const { return _fd; }
+
+  // Flush, optionally fdatasync, and move the file into place
+  bool commit(bool sync = false);
+
+private:
+  FileWriter(const std::string &path, const std::string &temp_path, int fd,
+             bool preallocated)
+      : _path(path), _temp_path(temp_path), _fd(fd),
+        _preallocated(preallocated) {}
+  FileWriter(const FileWriter &other) = delete;
+  FileWriter &operator=(const FileWriter &other) = delete;
+
+  bool write_direct(const char *data, size_t size);
+
+  static const size_t BLOCK_SIZE = 1024 * 1024;
+
+  const std::string _path;
+  // Empty when writing a special file in place
+  const std::string _temp_path;
+  int _fd;
+  const bool _preallocated;
+  bool _committed = false;
+  std::string _buffer;
 };
 
 bool read_file(const char *path, std::string &out);
 bool write_file(const char *path, const std::string_view &data);
 bool write_file(const char *path, const std::string &data);
 
+// Write all of the given buffers to fd, resuming after short writes.
+// The iovec array is used as scratch space and modified.
+bool writev_all(int fd, struct iovec *iov, size_t iovcnt);
+
 } // namespace mg::fs
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include <mg/util/arena.hpp>
+
+namespace mg::json {
+
+// Append `in` to `out` as a quoted JSON string, escaped the same way as
+// nlohmann::json::dump. Returns false if `in` is not valid UTF-8, in which
+// case `out` is left partially written.
+bool append_string(const std::string_view &in, std::string &out);
+
+// Minimal pieces for schema-specific parsers. Each works at `pos` in `data`
+// and advances it past whatever was consumed.
+
+// Skip JSON whitespace
+void skip_whitespace(const std::string_view &data, size_t &pos);
+
+// Skip whitespace, then consume `c`. Returns false if the next character is
+// anything else.
+bool consume(const std::string_view &data, size_t &pos, char c);
+
+// Skip whitespace, then parse a string. Strings without escapes are returned
+// as views into `data`, others are unescaped into `arena`. Returns false on
+// malformed strings, including those that are not valid UTF-8.
+bool parse_string(const std::string_view &data, size_t &pos,
+                  mg::util::Arena &arena, std::string_view &out);
+
+} // namespace mg::json
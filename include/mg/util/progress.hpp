@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace mg::util {
+
+// Shared between a long running operation and whoever is waiting on it. The
+// operation publishes how far it has got, and gives up early once
+// cancelled.
+struct Progress {
+  std::atomic<uint64_t> done{0};
+  // 0 if the amount of work is not known
+  std::atomic<uint64_t> total{0};
+  std::atomic<bool> cancelled{false};
+
+  // Fraction complete, or a negative value if the total is unknown
+  float fraction() const {
+    const uint64_t t = total.load(std::memory_order_relaxed);
+    return t == 0 ? -1.0f
+                  : (float)done.load(std::memory_order_relaxed) / (float)t;
+  }
+
+  void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+  bool is_cancelled() const {
+    return cancelled.load(std::memory_order_relaxed);
+  }
+};
+
+} // namespace mg::util
@@ -2,9 +2,12 @@
 
 #include <stdio.h>
 
+#include <string>
+#include <string_view>
+
 namespace mg::string {
 
-const std::string bytes_to_hex(const std::string &bytes) {
+inline const std::string bytes_to_hex(const std::string_view &bytes) {
   std::string ret;
   ret.resize(bytes.size() * 2);
   auto nibble_to_hex = [](uint8_t nibble) -> char {
@@ -23,6 +26,35 @@ const std::string bytes_to_hex(const std::string &bytes) {
   return ret;
 }
 
+// Inverse of bytes_to_hex. Accepts either case, returns false on malformed
+// input.
+inline bool hex_to_bytes(const std::string_view &hex, std::string &out) {
+  if (hex.size() % 2 != 0) {
+    return false;
+  }
+  auto hex_to_nibble = [](char c) -> int {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    return -1;
+  };
+
+  out.resize(hex.size() / 2);
+  for (std::string::size_type i = 0; i < out.size(); i++) {
+    const int hi = hex_to_nibble(hex[i * 2]);
+    const int lo = hex_to_nibble(hex[i * 2 + 1]);
+    if (hi < 0 || lo < 0) {
+      return false;
+    }
+    out[i] = (hi << 4) | lo;
+  }
+
+  return true;
+}
+
 template <typename... Args>
 std::string format(const std::string &format, Args... args) {
   size_t size = snprintf(nullptr, 0, format.c_str(), args...) + 1;
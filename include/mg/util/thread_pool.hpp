@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mg::util {
+
+// Fixed set of worker threads, each with its own task deque. Tasks submitted
+// from inside a worker go to the back of that worker's deque and are run
+// LIFO, so nested work is processed depth-first. Idle workers steal from the
+// front of other workers' deques.
+class ThreadPool {
+public:
+  // A thread count of 0 uses the hardware concurrency
+  explicit ThreadPool(unsigned thread_count = 0);
+  ~ThreadPool();
+
+  void submit(std::function<void()> task);
+
+  template <typename F> auto async(F &&f) -> std::future<decltype(f())> {
+    auto task = std::make_shared<std::packaged_task<decltype(f())()>>(
+        std::forward<F>(f));
+    auto ret = task->get_future();
+    submit([task]() { (*task)(); });
+    return ret;
+  }
+
+  // Block until all submitted tasks, including any tasks that they submit,
+  // have completed. Must not be called from a worker thread.
+  void wait_idle();
+
+  unsigned thread_count() const { return _threads.size(); }
+
+private:
+  ThreadPool(const ThreadPool &other) = delete;
+  ThreadPool &operator=(const ThreadPool &other) = delete;
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void run(unsigned index);
+  bool pop_task(unsigned index, std::function<void()> &out);
+
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::vector<std::thread> _threads;
+
+  // Guards sleeping / waking and the idle condition
+  std::mutex _mutex;
+  std::condition_variable _work_available;
+  std::condition_variable _idle;
+  bool _stopping = false;
+
+  // Tasks sitting in a deque, and tasks submitted but not yet finished
+  std::atomic<size_t> _queued{0};
+  size_t _pending = 0;
+
+  std::atomic<unsigned> _next_worker{0};
+};
+
+} // namespace mg::util
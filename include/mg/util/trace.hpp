@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+
+// Scoped timers that record per-thread spans, written out as a Chrome trace
+// (chrome://tracing, Perfetto) plus a summary table when a tool exits. Only
+// compiled in when configured with -DENABLE_TRACE=On, and only recording when
+// the MG_TRACE environment variable names the output path.
+//
+// Configuring with -DENABLE_ALLOC_TRACKING=On also counts every allocation,
+// attributing them to each span that was open on the allocating thread, and
+// reports the peak heap size.
+//
+//   MG_TRACE_SCOPE(TRACE_DECODE, "mzx_decompress");
+
+namespace mg::trace {
+
+enum Category {
+  TRACE_TOOL,
+  TRACE_READ,
+  TRACE_PARSE,
+  TRACE_HASH,
+  TRACE_DECODE,
+  TRACE_ENCODE,
+  TRACE_WRITE,
+};
+
+const char *category_name(Category category);
+
+struct AllocationCounts {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+#ifdef MG_TRACE_ALLOCATIONS
+
+// Allocations made through operator new so far, by the calling thread or by
+// the whole process
+AllocationCounts thread_allocations();
+AllocationCounts process_allocations();
+
+#endif
+
+#ifdef MG_TRACE_ENABLED
+
+// Whether MG_TRACE is set. The first call also arranges for the trace to be
+// written out at exit.
+bool active();
+uint64_t now_ns();
+void record(Category category, const char *name, uint64_t start_ns,
+            uint64_t end_ns, AllocationCounts allocations = {});
+
+class Scope {
+public:
+  // `name` must be a string literal, or otherwise outlive the process
+  Scope(Category category, const char *name)
+      : _category(category), _name(name), _start_ns(active() ? now_ns() : 0) {
+#ifdef MG_TRACE_ALLOCATIONS
+    _start_allocations = thread_allocations();
+#endif
+  }
+  ~Scope() {
+    if (_start_ns == 0) {
+      return;
+    }
+#ifdef MG_TRACE_ALLOCATIONS
+    const AllocationCounts end_allocations = thread_allocations();
+    record(_category, _name, _start_ns, now_ns(),
+           AllocationCounts{end_allocations.count - _start_allocations.count,
+                            end_allocations.bytes - _start_allocations.bytes});
+#else
+    record(_category, _name, _start_ns, now_ns());
+#endif
+  }
+
+private:
+  Scope(const Scope &other) = delete;
+  Scope &operator=(const Scope &other) = delete;
+
+  const Category _category;
+  const char *const _name;
+  const uint64_t _start_ns;
+#ifdef MG_TRACE_ALLOCATIONS
+  AllocationCounts _start_allocations;
+#endif
+};
+
+#define MG_TRACE_CONCAT_(a, b) a##b
+#define MG_TRACE_CONCAT(a, b) MG_TRACE_CONCAT_(a, b)
+#define MG_TRACE_SCOPE(category, name)                                         \
+  ::mg::trace::Scope MG_TRACE_CONCAT(mg_trace_scope_, __LINE__)(               \
+      ::mg::trace::category, name)
+
+#else
+
+#define MG_TRACE_SCOPE(category, name)                                         \
+  do {                                                                         \
+  } while (0)
+
+#endif
+
+} // namespace mg::trace
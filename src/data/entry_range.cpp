@@ -0,0 +1,129 @@
+#include <stdio.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <numeric>
+
+#include <mg/data/entry_range.hpp>
+
+namespace mg::data {
+
+static_assert(sizeof(EntryRange) == 16, "EntryRange is loaded as one vector");
+
+ssize_t entry_range_out_of_bounds(const std::vector<EntryRange> &ranges,
+                                  uint64_t data_size) {
+  // As offsets and sizes are below 2^62, data_size - (offset + size) only has
+  // its top bit set when the range runs past the end. OR them all together
+  // and test that bit once.
+  uint64_t wrapped = 0;
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128i limit = _mm_set1_epi64x(data_size);
+  __m128i accumulated = _mm_setzero_si128();
+  const __m128i *raw = reinterpret_cast<const __m128i *>(ranges.data());
+  for (; i + 2 <= ranges.size(); i += 2) {
+    // Each vector holds one (offset, size) pair
+    const __m128i a = _mm_loadu_si128(raw + i);
+    const __m128i b = _mm_loadu_si128(raw + i + 1);
+    const __m128i ends = _mm_add_epi64(_mm_unpacklo_epi64(a, b),
+                                       _mm_unpackhi_epi64(a, b));
+    accumulated = _mm_or_si128(accumulated, _mm_sub_epi64(limit, ends));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), accumulated);
+  wrapped = lanes[0] | lanes[1];
+#endif
+
+  for (; i < ranges.size(); i++) {
+    wrapped |= data_size - (ranges[i].offset + ranges[i].size);
+  }
+  if (!(wrapped >> 63)) {
+    return -1;
+  }
+
+  // Something is out of bounds, find out what
+  for (i = 0; i < ranges.size(); i++) {
+    if (ranges[i].offset + ranges[i].size > data_size) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+namespace {
+
+template <typename Index>
+void sweep_overlaps(const std::vector<EntryRange> &ranges, Index index,
+                    std::vector<EntryOverlap> &out) {
+  // Track whichever entry seen so far ends last. Anything starting before
+  // that end overlaps it.
+  bool have_furthest = false;
+  uint32_t furthest = 0;
+  uint64_t furthest_end = 0;
+  for (size_t i = 0; i < ranges.size(); i++) {
+    const uint32_t entry = index(i);
+    const EntryRange &range = ranges[entry];
+    if (range.size == 0) {
+      continue;
+    }
+    if (have_furthest && range.offset < furthest_end) {
+      out.push_back(EntryOverlap{furthest, entry});
+    }
+    if (!have_furthest || range.offset + range.size > furthest_end) {
+      have_furthest = true;
+      furthest = entry;
+      furthest_end = range.offset + range.size;
+    }
+  }
+}
+
+} // namespace
+
+void entry_range_overlaps(const std::vector<EntryRange> &ranges,
+                          std::vector<EntryOverlap> &out) {
+  // Archives are normally laid out in entry order, in which case there is
+  // nothing to sort
+  const bool in_order = std::is_sorted(
+      ranges.begin(), ranges.end(),
+      [](const EntryRange &a, const EntryRange &b) {
+        return a.offset < b.offset;
+      });
+  if (in_order) {
+    sweep_overlaps(
+        ranges, [](size_t i) { return (uint32_t)i; }, out);
+    return;
+  }
+
+  std::vector<uint32_t> order(ranges.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return ranges[a].offset < ranges[b].offset;
+  });
+  sweep_overlaps(
+      ranges, [&](size_t i) { return order[i]; }, out);
+}
+
+bool entry_ranges_validate(const char *kind,
+                           const std::vector<EntryRange> &ranges,
+                           uint64_t data_size,
+                           std::vector<EntryOverlap> &overlaps) {
+  const ssize_t bad_entry = entry_range_out_of_bounds(ranges, data_size);
+  if (bad_entry >= 0) {
+    const EntryRange &range = ranges[bad_entry];
+    fprintf(stderr,
+            "%s entry %ld (offset 0x%lx, size 0x%lx) extends past end of "
+            "data (0x%lx bytes)\n",
+            kind, bad_entry, range.offset, range.size, data_size);
+    return false;
+  }
+
+  overlaps.clear();
+  entry_range_overlaps(ranges, overlaps);
+  return true;
+}
+
+} // namespace mg::data
@@ -2,6 +2,7 @@
 
 #include <mg/data/hfa.hpp>
 #include <mg/util/endian.hpp>
+#include <mg/util/trace.hpp>
 
 namespace mg::data {
 
@@ -17,33 +18,61 @@ void Hfa::PackedEntryHeader::to_file_order() {
 
 std::unique_ptr<MappedHfa>
 MappedHfa::parse(std::shared_ptr<mg::fs::MappedFile> backing_data) {
+  return parse(backing_data->string_view(), backing_data);
+}
+
+std::unique_ptr<MappedHfa>
+MappedHfa::parse(std::string_view data,
+                 std::shared_ptr<mg::fs::MappedFile> backing_data) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "MappedHfa::parse");
   // Check file larger enough to have a header
-  if ((size_t)backing_data->size() < sizeof(Hfa::FileHeader)) {
+  if (data.size() < sizeof(Hfa::FileHeader)) {
     fprintf(stderr, "File too short to read header\n");
     return nullptr;
   }
 
   // Check magic is correct
-  Hfa::FileHeader header = *(Hfa::FileHeader *)backing_data->data();
+  Hfa::FileHeader header = *(const Hfa::FileHeader *)data.data();
   if (!!memcmp(header.magic, Hfa::MAGIC, strlen(Hfa::MAGIC))) {
     fprintf(stderr, "File has invalid magic\n");
     return nullptr;
   }
 
+  // Check the entry table fits
+  const uint32_t entry_count = le_to_host_u32(header.entry_count);
+  const uint64_t header_size_bytes =
+      sizeof(Hfa::FileHeader) +
+      (uint64_t)sizeof(Hfa::PackedEntryHeader) * entry_count;
+  if (data.size() < header_size_bytes) {
+    fprintf(stderr, "File too short for %u entry headers\n", entry_count);
+    return nullptr;
+  }
+
   // Parse each of the header entries
   std::vector<Hfa::PackedEntryHeader> entries;
-  const uint32_t entry_count = le_to_host_u32(header.entry_count);
+  std::vector<EntryRange> ranges;
+  entries.reserve(entry_count);
+  ranges.reserve(entry_count);
   const Hfa::PackedEntryHeader *entry_ptr =
-      reinterpret_cast<const Hfa::PackedEntryHeader *>(backing_data->data() +
+      reinterpret_cast<const Hfa::PackedEntryHeader *>(data.data() +
                                                        sizeof(Hfa::FileHeader));
   for (uint32_t i = 0; i < entry_count; i++, entry_ptr++) {
     // Copy the entry, convert it to host order and add it to our entry list
     Hfa::PackedEntryHeader entry = *entry_ptr;
     entry.to_host_order();
     entries.emplace_back(entry);
+    ranges.emplace_back(
+        EntryRange{header_size_bytes + entry.offset, entry.size});
+  }
+
+  // Check every entry lies within the data
+  std::vector<EntryOverlap> overlaps;
+  if (!entry_ranges_validate("HFA", ranges, data.size(), overlaps)) {
+    return nullptr;
   }
 
-  return std::unique_ptr<MappedHfa>(new MappedHfa(backing_data, entries));
+  return std::unique_ptr<MappedHfa>(
+      new MappedHfa(backing_data, data, entries, overlaps));
 }
 
 } // namespace mg::data
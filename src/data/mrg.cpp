@@ -2,6 +2,7 @@
 
 #include <mg/data/mrg.hpp>
 #include <mg/util/endian.hpp>
+#include <mg/util/trace.hpp>
 
 namespace mg::data {
 
@@ -17,7 +18,17 @@ void Mrg::PackedEntryHeader::to_file_order() {
   size_uncompressed_sectors = mg::host_to_le_u16(size_uncompressed_sectors);
 }
 
+namespace {
+
+EntryRange mrg_entry_range(const Mrg::PackedEntryHeader &header) {
+  return EntryRange{(uint64_t)header.offset * Mrg::SECTOR_SIZE,
+                    (uint64_t)header.size_sectors * Mrg::SECTOR_SIZE};
+}
+
+} // namespace
+
 bool mrg_read(const std::string &hed, const std::string &mrg, Mrg &out) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "mrg_read");
   if (hed.size() % sizeof(Mrg::PackedEntryHeader) != 0) {
     fprintf(stderr, "Wrong size for HED, must be multiple of %lu\n",
             sizeof(Mrg::PackedEntryHeader));
@@ -29,8 +40,8 @@ bool mrg_read(const std::string &hed, const std::string &mrg, Mrg &out) {
   const Mrg::PackedEntryHeader *raw_entries =
       reinterpret_cast<const Mrg::PackedEntryHeader *>(hed.data());
 
-  // Parse off each entry
-  out.entries.clear();
+  // Load the entry table
+  std::vector<EntryRange> ranges;
   for (ssize_t i = 0; i < entry_count; i++) {
     // Copy current header
     Mrg::PackedEntryHeader header = raw_entries[i];
@@ -43,16 +54,41 @@ bool mrg_read(const std::string &hed, const std::string &mrg, Mrg &out) {
       break;
     }
 
-    // Excise the source data at the specified offset + len
-    out.entries.emplace_back(
-        std::string(&mrg[header.offset * Mrg::SECTOR_SIZE],
-                    header.size_sectors * Mrg::SECTOR_SIZE));
+    ranges.emplace_back(mrg_entry_range(header));
+  }
+
+  // Check every entry lies within the data before copying any of it
+  const ssize_t bad_entry = entry_range_out_of_bounds(ranges, mrg.size());
+  if (bad_entry >= 0) {
+    fprintf(stderr, "MRG entry %ld extends past end of data\n", bad_entry);
+    return false;
+  }
+
+  // Excise the source data at each offset + len
+  out.entries.clear();
+  for (auto &range : ranges) {
+    out.entries.emplace_back(std::string(&mrg[range.offset], range.size));
   }
 
   return true;
 }
 
+uint64_t mrg_data_size(const Mrg &in) {
+  uint64_t size = 0;
+  for (auto &entry : in.entries) {
+    size +=
+        (uint64_t)Mrg::size_in_sectors(entry.data.size()) * Mrg::SECTOR_SIZE;
+  }
+  return size;
+}
+
 bool mrg_write(const Mrg &in, std::string &hed, std::string &mrg) {
+  mrg.resize(mrg_data_size(in));
+  return mrg_write(in, hed, reinterpret_cast<uint8_t *>(mrg.data()));
+}
+
+bool mrg_write(const Mrg &in, std::string &hed, uint8_t *mrg) {
+  MG_TRACE_SCOPE(TRACE_ENCODE, "mrg_write");
   // Work out the total header size
   // Note that there are 2 extra header entries of 0xFF for EOF
   const ssize_t header_size =
@@ -63,7 +99,6 @@ bool mrg_write(const Mrg &in, std::string &hed, std::string &mrg) {
   Mrg::PackedEntryHeader *headers =
       reinterpret_cast<Mrg::PackedEntryHeader *>(hed.data());
   ssize_t mrg_write_offset_sectors = 0;
-  mrg.clear();
   for (unsigned i = 0; i < in.entries.size(); i++) {
     // Pack header
     headers[i].offset = mrg_write_offset_sectors;
@@ -79,10 +114,12 @@ bool mrg_write(const Mrg &in, std::string &hed, std::string &mrg) {
           Mrg::size_in_sectors(in.entries[i].data.size());
     }
 
-    // Copy data
-    mrg.resize(mrg.size() + headers[i].size_sectors * Mrg::SECTOR_SIZE, '\0');
-    memcpy(&mrg[mrg_write_offset_sectors * Mrg::SECTOR_SIZE],
-           in.entries[i].data.data(), in.entries[i].data.size());
+    // Copy data and zero the padding up to the sector boundary
+    uint8_t *out = &mrg[mrg_write_offset_sectors * Mrg::SECTOR_SIZE];
+    const size_t data_size = in.entries[i].data.size();
+    memcpy(out, in.entries[i].data.data(), data_size);
+    memset(out + data_size, 0,
+           headers[i].size_sectors * Mrg::SECTOR_SIZE - data_size);
 
     // Increment write offset
     mrg_write_offset_sectors += headers[i].size_sectors;
@@ -100,6 +137,17 @@ bool mrg_write(const Mrg &in, std::string &hed, std::string &mrg) {
 std::unique_ptr<MappedMrg>
 MappedMrg::parse(const std::string &hed,
                  std::shared_ptr<mg::fs::MappedFile> backing_data) {
+  if (backing_data == nullptr) {
+    fprintf(stderr, "No MRG data to parse\n");
+    return nullptr;
+  }
+  return parse(hed, backing_data->string_view(), backing_data);
+}
+
+std::unique_ptr<MappedMrg>
+MappedMrg::parse(const std::string &hed, std::string_view data,
+                 std::shared_ptr<mg::fs::MappedFile> backing_data) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "MappedMrg::parse");
   // Check header size valid
   if (hed.size() % sizeof(Mrg::PackedEntryHeader) != 0) {
     fprintf(stderr, "Wrong size for HED, must be multiple of %lu\n",
@@ -114,6 +162,7 @@ MappedMrg::parse(const std::string &hed,
 
   // Load entry table
   std::vector<Mrg::PackedEntryHeader> entries;
+  std::vector<EntryRange> ranges;
   for (ssize_t i = 0; i < entry_count; i++) {
     // Copy current header
     Mrg::PackedEntryHeader header = raw_entries[i];
@@ -128,9 +177,17 @@ MappedMrg::parse(const std::string &hed,
 
     // Emplace into list
     entries.emplace_back(header);
+    ranges.emplace_back(mrg_entry_range(header));
+  }
+
+  // Check every entry lies within the data
+  std::vector<EntryOverlap> overlaps;
+  if (!entry_ranges_validate("MRG", ranges, data.size(), overlaps)) {
+    return nullptr;
   }
 
-  return std::unique_ptr<MappedMrg>(new MappedMrg(backing_data, entries));
+  return std::unique_ptr<MappedMrg>(
+      new MappedMrg(backing_data, data, entries, overlaps));
 }
 
 } // namespace mg::data
@@ -2,6 +2,7 @@
 
 #include <mg/data/mzp.hpp>
 #include <mg/util/endian.hpp>
+#include <mg/util/trace.hpp>
 
 namespace mg::data {
 
@@ -25,7 +26,7 @@ void Mzp::MzpArchiveEntry::to_file_order() {
   size_bytes = host_to_le_u16(size_bytes);
 }
 
-void Mzp::MzpArchiveEntry::print() {
+void Mzp::MzpArchiveEntry::print() const {
   fprintf(stderr,
           "MzpArchiveEntry:\n"
           "    Sector offset:   %08x\n"
@@ -52,62 +53,75 @@ void Mzp::MzpArchiveEntry::set_data_size(uint32_t size) {
   size_bytes = size & 0xFFFF;
 }
 
-void mzp_write(const Mzp &mzp, std::string &out) {
-  // Clear output
-  out.clear();
+void MzpWriter::add_entry(std::string_view data) {
+  // Entries are packed back to back, so the offset is the running data size
+  Mzp::MzpArchiveEntry entry_header;
+  entry_header.set_offsets(_data_size);
+  entry_header.set_data_size(data.size());
+  entry_header.to_file_order();
+  _entry_headers.emplace_back(entry_header);
+  _entry_data.emplace_back(data);
+  _data_size += data.size();
+}
 
-  // Write header
+Mzp::MzpArchiveHeader MzpWriter::file_header() const {
   Mzp::MzpArchiveHeader header;
   memcpy(header.magic, Mzp::FILE_MAGIC, sizeof(Mzp::MzpArchiveHeader::magic));
-  header.archive_entry_count = mzp.entry_headers.size();
+  header.archive_entry_count = _entry_headers.size();
   header.to_file_order();
-  out.resize(sizeof(header));
-  memcpy(&out[0], &header, sizeof(header));
+  return header;
+}
 
-  // Calculate the data segment start
-  std::string::size_type data_segment_start =
-      sizeof(Mzp::MzpArchiveHeader) +
-      sizeof(Mzp::MzpArchiveEntry) * mzp.entry_headers.size();
-
-  // Clone the header data so that we can recalculate it
-  std::vector<Mzp::MzpArchiveEntry> entry_headers = mzp.entry_headers;
-  std::string::size_type current_data_offset = 0;
-  for (unsigned i = 0; i < mzp.entry_headers.size(); i++) {
-    Mzp::MzpArchiveEntry &entry_header = entry_headers[i];
-    auto &entry_data = mzp.entry_data[i];
-    const std::string::size_type entry_size = entry_data.size();
-    entry_header.set_offsets(current_data_offset);
-    entry_header.set_data_size(entry_size);
-    current_data_offset += entry_size;
-    // Pad current data offset to 16 byte boundary
-    // const std::string::size_type real_data_end_addr =
-    //     data_segment_start + current_data_offset;
-    // current_data_offset += 16 - (real_data_end_addr % 16);
+void MzpWriter::write(uint8_t *out) const {
+  MG_TRACE_SCOPE(TRACE_ENCODE, "MzpWriter::write_buffer");
+  // Header
+  const Mzp::MzpArchiveHeader header = file_header();
+  memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+
+  // Entry table
+  const size_t entry_table_size =
+      sizeof(Mzp::MzpArchiveEntry) * _entry_headers.size();
+  memcpy(out, _entry_headers.data(), entry_table_size);
+  out += entry_table_size;
+
+  // Entry data
+  for (auto &entry_data : _entry_data) {
+    memcpy(out, entry_data.data(), entry_data.size());
+    out += entry_data.size();
+  }
+}
+
+bool MzpWriter::write(int fd) const {
+  MG_TRACE_SCOPE(TRACE_WRITE, "MzpWriter::write_fd");
+  const Mzp::MzpArchiveHeader header = file_header();
+
+  // One buffer each for the header and the entry table, then one per entry
+  std::vector<struct iovec> iov;
+  iov.reserve(2 + _entry_data.size());
+  iov.push_back({const_cast<Mzp::MzpArchiveHeader *>(&header), sizeof(header)});
+  iov.push_back({const_cast<Mzp::MzpArchiveEntry *>(_entry_headers.data()),
+                 sizeof(Mzp::MzpArchiveEntry) * _entry_headers.size()});
+  for (auto &entry_data : _entry_data) {
+    iov.push_back({const_cast<char *>(entry_data.data()), entry_data.size()});
   }
 
-  // Calculate total file size
-  const std::string::size_type output_size =
-      data_segment_start + current_data_offset;
-  out.resize(output_size, 0xFF);
-
-  // Write out each datum pair, since we need to use the header to get the
-  // correct data offset
-  for (unsigned i = 0; i < mzp.entry_headers.size(); i++) {
-    // Convert header to file order and emit
-    auto &entry_header = entry_headers[i];
-    entry_header.to_file_order();
-    const std::string::size_type header_output_offset =
-        sizeof(Mzp::MzpArchiveHeader) + sizeof(Mzp::MzpArchiveEntry) * i;
-    memcpy(&out[header_output_offset], &entry_header, sizeof(entry_header));
+  return mg::fs::writev_all(fd, iov.data(), iov.size());
+}
 
-    // Insert data at data start + data offset
-    auto &entry_data = mzp.entry_data[i];
-    memcpy(&out[data_segment_start + entry_header.data_offset_relative()],
-           entry_data.data(), entry_data.size());
+void mzp_write(const Mzp &mzp, std::string &out) {
+  MG_TRACE_SCOPE(TRACE_ENCODE, "mzp_write");
+  MzpWriter writer;
+  for (auto &entry_data : mzp.entry_data) {
+    writer.add_entry(entry_data);
   }
+
+  out.resize(writer.size());
+  writer.write(reinterpret_cast<uint8_t *>(out.data()));
 }
 
 bool mzp_read(const std::string &data, Mzp &out) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "mzp_read");
   // Is file large enough to have a header
   if (data.size() < sizeof(Mzp::MzpArchiveHeader)) {
     return false;
@@ -123,11 +137,22 @@ bool mzp_read(const std::string &data, Mzp &out) {
     return false;
   }
 
+  // Check the entry table fits
+  const size_t data_start_offset =
+      sizeof(Mzp::MzpArchiveHeader) +
+      sizeof(Mzp::MzpArchiveEntry) * out.header.archive_entry_count;
+  if (data.size() < data_start_offset) {
+    fprintf(stderr, "MZP data too short for %u entry headers\n",
+            out.header.archive_entry_count);
+    return false;
+  }
+
   // Clear output vecs
   out.entry_headers.clear();
   out.entry_data.clear();
 
   // Iterate the archive entries
+  std::vector<EntryRange> ranges;
   for (uint16_t i = 0; i < out.header.archive_entry_count; i++) {
     // Calculate start offset of header record
     std::string::size_type archive_header_offset =
@@ -141,15 +166,89 @@ bool mzp_read(const std::string &data, Mzp &out) {
 
     // Add to header
     out.entry_headers.emplace_back(entry);
+    ranges.emplace_back(EntryRange{
+        data_start_offset + entry.data_offset_relative(),
+        entry.entry_data_size()});
+  }
+
+  // Check every entry lies within the data before copying any of it
+  const ssize_t bad_entry = entry_range_out_of_bounds(ranges, data.size());
+  if (bad_entry >= 0) {
+    fprintf(stderr, "MZP entry %ld extends past end of data\n", bad_entry);
+    out.entry_headers.clear();
+    return false;
   }
 
   // Scan through and extract the actual archive data
-  for (auto &entry : out.entry_headers) {
-    out.entry_data.emplace_back(&data[out.archive_entry_start_offset(entry)],
-                                entry.entry_data_size());
+  for (auto &range : ranges) {
+    out.entry_data.emplace_back(&data[range.offset], range.size);
   }
 
   return true;
 }
 
+std::unique_ptr<MappedMzp>
+MappedMzp::parse(std::shared_ptr<mg::fs::MappedFile> backing_data) {
+  return parse(backing_data->string_view(), backing_data);
+}
+
+std::unique_ptr<MappedMzp>
+MappedMzp::parse(std::string_view data,
+                 std::shared_ptr<mg::fs::MappedFile> backing_data) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "MappedMzp::parse");
+  // Is data large enough to have a header
+  if (data.size() < sizeof(Mzp::MzpArchiveHeader)) {
+    fprintf(stderr, "MZP data too short to read header\n");
+    return nullptr;
+  }
+
+  // Read off header
+  Mzp::MzpArchiveHeader header =
+      *reinterpret_cast<const Mzp::MzpArchiveHeader *>(data.data());
+  header.to_host_order();
+
+  // Valid magic?
+  if (memcmp(header.magic, Mzp::FILE_MAGIC,
+             sizeof(Mzp::MzpArchiveHeader::magic)) != 0) {
+    fprintf(stderr, "MZP data has invalid magic\n");
+    return nullptr;
+  }
+
+  // Check the entry table fits
+  const size_t data_start_offset =
+      sizeof(Mzp::MzpArchiveHeader) +
+      sizeof(Mzp::MzpArchiveEntry) * header.archive_entry_count;
+  if (data.size() < data_start_offset) {
+    fprintf(stderr, "MZP data too short for %u entry headers\n",
+            header.archive_entry_count);
+    return nullptr;
+  }
+
+  // Load the entry table
+  std::vector<Mzp::MzpArchiveEntry> entries;
+  std::vector<EntryRange> ranges;
+  entries.reserve(header.archive_entry_count);
+  ranges.reserve(header.archive_entry_count);
+  const Mzp::MzpArchiveEntry *raw_entries =
+      reinterpret_cast<const Mzp::MzpArchiveEntry *>(
+          data.data() + sizeof(Mzp::MzpArchiveHeader));
+  for (uint16_t i = 0; i < header.archive_entry_count; i++) {
+    Mzp::MzpArchiveEntry entry = raw_entries[i];
+    entry.to_host_order();
+    entries.emplace_back(entry);
+    ranges.emplace_back(EntryRange{
+        data_start_offset + entry.data_offset_relative(),
+        entry.entry_data_size()});
+  }
+
+  // Check every entry lies within the data
+  std::vector<EntryOverlap> overlaps;
+  if (!entry_ranges_validate("MZP", ranges, data.size(), overlaps)) {
+    return nullptr;
+  }
+
+  return std::unique_ptr<MappedMzp>(
+      new MappedMzp(backing_data, data, header, entries, overlaps));
+}
+
 } // namespace mg::data
@@ -2,6 +2,7 @@
 
 #include <mg.hpp>
 #include <mg/data/mzx.hpp>
+#include <mg/util/trace.hpp>
 
 namespace mg::data {
 
@@ -10,28 +11,49 @@ static const uint8_t CMD_BACKREF = 1;
 static const uint8_t CMD_RINGBUF = 2;
 static const uint8_t CMD_LITERAL = 3;
 
-bool mzx_compress(const std::string &raw, std::string &out, bool invert) {
+size_t mzx_compress_bound(size_t raw_size) {
+  return sizeof(MzxHeader) + raw_size + 2 * ((raw_size / 128) + 1);
+}
+
+bool mzx_compress(const std::string_view &raw, std::string &out, bool invert) {
+  // Estimate our final size
+  out.resize(mzx_compress_bound(raw.size()));
+
+  size_t output_size = out.size();
+  if (!mzx_compress(raw, reinterpret_cast<uint8_t *>(out.data()), output_size,
+                    invert)) {
+    return false;
+  }
+
+  // Shrink the output size down to the bytes we actually wrote
+  out.resize(output_size);
+  return true;
+}
+
+bool mzx_compress(const std::string_view &raw, uint8_t *out, size_t &out_size,
+                  bool invert) {
+  MG_TRACE_SCOPE(TRACE_ENCODE, "mzx_compress");
+  if (out_size < mzx_compress_bound(raw.size())) {
+    fprintf(stderr, "Output buffer too small\n");
+    return false;
+  }
+
   // Don't bother actually compressing the data for now, just emit a valid
   // stream of literals
   MzxHeader header;
   memcpy(header.magic, MzxHeader::FILE_MAGIC, sizeof(header.magic));
   header.decompressed_size = raw.size();
 
-  // Estimate our final size
-  const std::string::size_type output_size =
-      sizeof(header) + raw.size() + 2 * ((raw.size() / 128) + 1);
-  out.resize(output_size);
-
   // Write header
-  std::string::size_type output_offset = 0;
+  size_t output_offset = 0;
   header.to_file_order();
-  memcpy(out.data(), &header, sizeof(header));
+  memcpy(out, &header, sizeof(header));
   output_offset += sizeof(header);
 
-  for (std::string::size_type pos = 0; pos < raw.size();) {
+  for (size_t pos = 0; pos < raw.size();) {
     // Len field is 6 bits, each word is 2 bytes, we can write 128 bytes per
     // literal record
-    const std::string::size_type bytes_remaining = raw.size() - pos;
+    const size_t bytes_remaining = raw.size() - pos;
     const unsigned bytes_to_write =
         bytes_remaining < 128 ? bytes_remaining : 128;
 
@@ -52,8 +74,7 @@ bool mzx_compress(const std::string &raw, std::string &out, bool invert) {
     // Write the next bytes_to_write datums
     memcpy(&out[output_offset], &raw[pos], bytes_to_write);
     if (invert) {
-      for (std::string::size_type i = output_offset;
-           i < output_offset + bytes_to_write; i++) {
+      for (size_t i = output_offset; i < output_offset + bytes_to_write; i++) {
         out[i] ^= 0xFF;
       }
     }
@@ -63,14 +84,12 @@ bool mzx_compress(const std::string &raw, std::string &out, bool invert) {
     pos += bytes_to_write;
   }
 
-  // Shrink the output size down to the bytes we actually wrote
-  out.resize(output_offset);
-
+  out_size = output_offset;
   return true;
 }
 
-bool mzx_decompress(const std::string &compressed, std::string &out,
-                    bool invert) {
+bool mzx_decompressed_size(const std::string_view &compressed,
+                           uint32_t &out) {
   // If header is too small, bail immediately
   if (compressed.size() < sizeof(MzxHeader)) {
     fprintf(stderr, "Header too small\n");
@@ -87,8 +106,36 @@ bool mzx_decompress(const std::string &compressed, std::string &out,
     return false;
   }
 
+  out = header.decompressed_size;
+  return true;
+}
+
+bool mzx_decompress(const std::string_view &compressed, std::string &out,
+                    bool invert, mg::util::Progress *progress) {
+  uint32_t decompressed_size;
+  if (!mzx_decompressed_size(compressed, decompressed_size)) {
+    return false;
+  }
+
   // Resize output buffer to accomodate decompressed data
-  out.resize(header.decompressed_size);
+  out.resize(decompressed_size);
+  return mzx_decompress(compressed, reinterpret_cast<uint8_t *>(out.data()),
+                        out.size(), invert, progress);
+}
+
+bool mzx_decompress(const std::string_view &compressed, uint8_t *out,
+                    size_t out_size, bool invert,
+                    mg::util::Progress *progress) {
+  MG_TRACE_SCOPE(TRACE_DECODE, "mzx_decompress");
+  uint32_t decompressed_size;
+  if (!mzx_decompressed_size(compressed, decompressed_size)) {
+    return false;
+  }
+  if (out_size < decompressed_size) {
+    fprintf(stderr, "Output buffer too small\n");
+    return false;
+  }
+  out_size = decompressed_size;
 
   // Last written short
   uint8_t last[2];
@@ -102,12 +149,34 @@ bool mzx_decompress(const std::string &compressed, std::string &out,
   int clear_count = 0;
 
   // Start reading right after the header
-  std::string::size_type read_offset = sizeof(MzxHeader);
-  std::string::size_type decompress_offset = 0;
+  size_t read_offset = sizeof(MzxHeader);
+  size_t decompress_offset = 0;
   unsigned ring_buffer_write_offset = 0;
+
+  // Truncated streams read as zero rather than off the end of the input
+  auto read_byte = [&]() -> uint8_t {
+    const size_t offset = read_offset++;
+    return offset < compressed.size() ? compressed[offset] : 0;
+  };
+
+  // Commands until progress is next reported
+  static constexpr unsigned PROGRESS_INTERVAL = 64 * 1024;
+  unsigned progress_countdown = PROGRESS_INTERVAL;
+  if (progress != nullptr) {
+    progress->total = compressed.size();
+  }
+
   while (read_offset < compressed.size()) {
+    if (progress != nullptr && --progress_countdown == 0) {
+      progress_countdown = PROGRESS_INTERVAL;
+      progress->done.store(read_offset, std::memory_order_relaxed);
+      if (progress->is_cancelled()) {
+        return false;
+      }
+    }
+
     // Get type / len
-    const uint8_t len_cmd = compressed[read_offset++];
+    const uint8_t len_cmd = read_byte();
     const unsigned cmd = len_cmd & 0b11;
     const unsigned len = len_cmd >> 2;
 
@@ -118,9 +187,9 @@ bool mzx_decompress(const std::string &compressed, std::string &out,
     }
 
     auto emit_byte = [&](uint8_t byte) {
-      if (decompress_offset >= out.size()) {
+      if (decompress_offset >= out_size) {
         // fprintf(stderr, "Tried to write %d bytes past end of buffer: %02x\n",
-        //         (int)decompress_offset - (int)out.size(), byte);
+        //         (int)decompress_offset - (int)out_size, byte);
         return;
       }
       out[decompress_offset++] = byte;
@@ -137,11 +206,13 @@ bool mzx_decompress(const std::string &compressed, std::string &out,
     } break;
 
     case CMD_BACKREF: {
-      const int lookback_distance =
-          2 * (static_cast<uint8_t>(compressed[read_offset++]) + 1);
+      const size_t lookback_distance = 2 * (read_byte() + 1);
       for (unsigned i = 0; i <= len; i++) {
-        const std::string::size_type lookback_offset =
-            decompress_offset - lookback_distance;
+        if (lookback_distance > decompress_offset) {
+          fprintf(stderr, "Backreference before start of data\n");
+          return false;
+        }
+        const size_t lookback_offset = decompress_offset - lookback_distance;
 
         // Read 2 bytes into last buffer
         last[0] = out[lookback_offset];
@@ -164,8 +235,8 @@ bool mzx_decompress(const std::string &compressed, std::string &out,
 
     case CMD_LITERAL: {
       for (unsigned i = 0; i <= len; i++) {
-        const uint8_t r0 = compressed[read_offset++] ^ (invert ? 0xFF : 0x00);
-        const uint8_t r1 = compressed[read_offset++] ^ (invert ? 0xFF : 0x00);
+        const uint8_t r0 = read_byte() ^ (invert ? 0xFF : 0x00);
+        const uint8_t r1 = read_byte() ^ (invert ? 0xFF : 0x00);
 
         // Update last
         last[0] = r0;
@@ -184,6 +255,9 @@ bool mzx_decompress(const std::string &compressed, std::string &out,
     }
   }
 
+  if (progress != nullptr) {
+    progress->done.store(compressed.size(), std::memory_order_relaxed);
+  }
   return true;
 }
 
@@ -1,10 +1,43 @@
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <mg/data/nam.hpp>
+#include <mg/util/trace.hpp>
 
 namespace mg::data {
 
+// Length of the name in a single record, which ends at the first nul, the
+// first \r\n or the end of the record
+static unsigned record_length(const char *record) {
+  static_assert(Nam::MAX_STRLEN == 32);
+#ifdef __SSE2__
+  const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(record));
+  const __m128i hi =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(record + 16));
+  auto match = [&](char c) -> uint32_t {
+    const __m128i needle = _mm_set1_epi8(c);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(lo, needle)) |
+           ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(hi, needle)) << 16);
+  };
+  // A \r only terminates if the next byte in the record is \n
+  const uint32_t end_mask = match('\0') | (match('\r') & (match('\n') >> 1));
+  return end_mask ? __builtin_ctz(end_mask) : Nam::MAX_STRLEN;
+#else
+  unsigned len = 0;
+  for (; len < Nam::MAX_STRLEN && record[len] != '\0' &&
+         !(record[len] == '\r' && len + 1 < Nam::MAX_STRLEN &&
+           record[len + 1] == '\n');
+       len++) {
+  }
+  return len;
+#endif
+}
+
 bool nam_read(const std::string &data, Nam &out) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "nam_read");
   // If this file isn't aligned to MAX_STRLEN byte entries, it might not be a
   // NAM
   if (data.size() % Nam::MAX_STRLEN != 0) {
@@ -19,12 +52,8 @@ bool nam_read(const std::string &data, Nam &out) {
   std::string::size_type read_offset = 0;
   while (read_offset < data.size()) {
     // Read up to nul byte, max strlen or \r\n
-    int len = 0;
     const char *str = &data[read_offset];
-    for (; len < Nam::MAX_STRLEN && str[len] != '\0' &&
-           !(str[len] == '\r' && str[len + 1] == '\n');
-         len++) {
-    }
+    const unsigned len = record_length(str);
     if (len != 0) {
       out.names.emplace_back(str, len);
     }
@@ -35,7 +64,39 @@ bool nam_read(const std::string &data, Nam &out) {
   return true;
 }
 
+std::unique_ptr<NamView>
+NamView::parse(std::shared_ptr<mg::fs::MappedFile> backing_data) {
+  return parse(backing_data->string_view(), backing_data);
+}
+
+std::unique_ptr<NamView>
+NamView::parse(std::string_view data,
+               std::shared_ptr<mg::fs::MappedFile> backing_data) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "NamView::parse");
+  // If this file isn't aligned to MAX_STRLEN byte entries, it might not be a
+  // NAM
+  if (data.size() % Nam::MAX_STRLEN != 0) {
+    fprintf(stderr, "Wrong size for NAM data file\n");
+    return nullptr;
+  }
+
+  // Measure every record in one pass, skipping empty ones as nam_read does
+  const size_t record_count = data.size() / Nam::MAX_STRLEN;
+  std::vector<std::string_view> names;
+  names.reserve(record_count);
+  for (size_t i = 0; i < record_count; i++) {
+    const char *record = data.data() + i * Nam::MAX_STRLEN;
+    const unsigned len = record_length(record);
+    if (len != 0) {
+      names.emplace_back(record, len);
+    }
+  }
+
+  return std::unique_ptr<NamView>(new NamView(backing_data, std::move(names)));
+}
+
 bool nam_write(const Nam &in, std::string &out) {
+  MG_TRACE_SCOPE(TRACE_ENCODE, "nam_write");
   // Resize output buffer to fit string table + EOF marker
   out.resize((in.names.size() + 1) * Nam::MAX_STRLEN, '\0');
 
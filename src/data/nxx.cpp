@@ -2,14 +2,57 @@
 
 #include <zlib.h>
 
+#include <algorithm>
+
 #include <mg/data/nxx.hpp>
 #include <mg/util/endian.hpp>
+#include <mg/util/trace.hpp>
 
 namespace mg::data {
 
 static const char *MAGIC_NXCX = "NXCX";
 static const char *MAGIC_NXGX = "NXGX";
 
+namespace {
+
+// Bytes of output inflated between progress reports
+constexpr uInt PROGRESS_SLICE = 1 << 20;
+
+// Run inflate() with `flush` over the stream's whole output. If a progress
+// tracker is given, the output is filled a slice at a time, with the
+// compressed bytes consumed published between slices. `err` is the result of
+// the last inflate() call. Returns false if cancelled.
+bool inflate_with_progress(z_stream &stream, int flush,
+                           mg::util::Progress *progress, int &err) {
+  if (progress == nullptr) {
+    err = inflate(&stream, flush);
+    return true;
+  }
+
+  const uInt in_size = stream.avail_in;
+  uInt out_left = stream.avail_out;
+  progress->total = in_size;
+  while (true) {
+    const uInt slice = std::min(out_left, PROGRESS_SLICE);
+    stream.avail_out = slice;
+    err = inflate(&stream, flush);
+    out_left -= slice - stream.avail_out;
+    progress->done.store(in_size - stream.avail_in,
+                         std::memory_order_relaxed);
+
+    // Stopping short of the end of a slice means there is nothing more to do
+    if (stream.avail_out != 0 || out_left == 0 ||
+        (err != Z_OK && err != Z_BUF_ERROR)) {
+      return true;
+    }
+    if (progress->is_cancelled()) {
+      return false;
+    }
+  }
+}
+
+} // namespace
+
 void Nxx::to_host_order() {
   size = mg::le_to_host_u32(size);
   compressed_size = mg::le_to_host_u32(compressed_size);
@@ -53,7 +96,23 @@ bool extract_nxx_header(const std::string_view &in, Nxx &out) {
   return true;
 }
 
-bool nxx_decompress(const std::string_view &in, std::string &out) {
+bool nxx_decompress(const std::string_view &in, std::string &out,
+                    mg::util::Progress *progress) {
+  Nxx header;
+  if (!extract_nxx_header(in, header)) {
+    fprintf(stderr, "Invalid file magic\n");
+    return false;
+  }
+
+  // Expand output to hold data
+  out.resize(header.size);
+  return nxx_decompress(in, reinterpret_cast<uint8_t *>(out.data()),
+                        out.size(), progress);
+}
+
+bool nxx_decompress(const std::string_view &in, uint8_t *out, size_t out_size,
+                    mg::util::Progress *progress) {
+  MG_TRACE_SCOPE(TRACE_DECODE, "nxx_decompress");
   // Input large enough to contain header?
   if (in.size() < sizeof(Nxx)) {
     fprintf(stderr, "NXX file too small\n");
@@ -67,9 +126,9 @@ bool nxx_decompress(const std::string_view &in, std::string &out) {
   // Check magic
   const uint8_t *data_ptr = reinterpret_cast<const uint8_t *>(&in[sizeof(Nxx)]);
   if (!strncmp(header.magic, MAGIC_NXCX, sizeof(header.magic))) {
-    return nxcx_decompress(header, data_ptr, out);
+    return nxcx_decompress(header, data_ptr, out, out_size, progress);
   } else if (!strncmp(header.magic, MAGIC_NXGX, sizeof(header.magic))) {
-    return nxgx_decompress(header, data_ptr, out);
+    return nxgx_decompress(header, data_ptr, out, out_size, progress);
   } else {
     fprintf(stderr, "Invalid file magic\n");
     return false;
@@ -79,13 +138,23 @@ bool nxx_decompress(const std::string_view &in, std::string &out) {
 bool nxgx_decompress(const Nxx &header, const uint8_t *data, std::string &out) {
   // Expand output to hold data
   out.resize(header.size);
+  return nxgx_decompress(header, data, reinterpret_cast<uint8_t *>(out.data()),
+                         out.size());
+}
+
+bool nxgx_decompress(const Nxx &header, const uint8_t *data, uint8_t *out,
+                     size_t out_size, mg::util::Progress *progress) {
+  if (out_size < header.size) {
+    fprintf(stderr, "Output buffer too small\n");
+    return false;
+  }
 
   // Create inflate stream
   z_stream istream{};
   istream.avail_in = header.compressed_size;
   istream.next_in = const_cast<uint8_t *>(data);
   istream.avail_out = header.size;
-  istream.next_out = reinterpret_cast<uint8_t *>(out.data());
+  istream.next_out = out;
   istream.total_out = 0;
 
   // Init inflate context
@@ -95,7 +164,11 @@ bool nxgx_decompress(const Nxx &header, const uint8_t *data, std::string &out) {
   }
 
   // Perform inflation
-  const int err = inflate(&istream, Z_SYNC_FLUSH);
+  int err;
+  if (!inflate_with_progress(istream, Z_SYNC_FLUSH, progress, err)) {
+    inflateEnd(&istream);
+    return false;
+  }
   if (err != Z_OK && err != Z_STREAM_END) {
     fprintf(stderr, "zlib error: %d: %s\n", err, istream.msg);
     return false;
@@ -112,18 +185,32 @@ bool nxgx_decompress(const Nxx &header, const uint8_t *data, std::string &out) {
 bool nxcx_decompress(const Nxx &header, const uint8_t *data, std::string &out) {
   // Expand output to hold data
   out.resize(header.size);
+  return nxcx_decompress(header, data, reinterpret_cast<uint8_t *>(out.data()),
+                         out.size());
+}
+
+bool nxcx_decompress(const Nxx &header, const uint8_t *data, uint8_t *out,
+                     size_t out_size, mg::util::Progress *progress) {
+  if (out_size < header.size) {
+    fprintf(stderr, "Output buffer too small\n");
+    return false;
+  }
 
   // Create inflate stream
   z_stream istream{};
   istream.avail_in = header.compressed_size;
   istream.next_in = const_cast<uint8_t *>(data);
   istream.avail_out = header.size;
-  istream.next_out = reinterpret_cast<uint8_t *>(out.data());
+  istream.next_out = out;
   istream.total_out = 0;
 
   // Perform inflation
   inflateInit(&istream);
-  const int err = inflate(&istream, Z_FINISH);
+  int err;
+  if (!inflate_with_progress(istream, Z_FINISH, progress, err)) {
+    inflateEnd(&istream);
+    return false;
+  }
   if (err != Z_STREAM_END && err != Z_OK) {
     fprintf(stderr, "zlib error: %d: %s\n", err, istream.msg);
     return false;
@@ -137,19 +224,42 @@ bool nxcx_decompress(const Nxx &header, const uint8_t *data, std::string &out) {
   return true;
 }
 
+size_t nxgx_compress_bound(size_t in_size) {
+  // compressBound() assumes a zlib wrapper, the gzip wrapper is 12 bytes
+  // larger
+  return sizeof(Nxx) + compressBound(in_size) + 12;
+}
+
 bool nxgx_compress(const std::string_view &in, std::string &out) {
+  out.resize(nxgx_compress_bound(in.size()));
+
+  size_t out_size = out.size();
+  if (!nxgx_compress(in, reinterpret_cast<uint8_t *>(out.data()), out_size)) {
+    return false;
+  }
+
+  // Shrunk output buffer to wrap
+  out.resize(out_size);
+  return true;
+}
+
+bool nxgx_compress(const std::string_view &in, uint8_t *out,
+                   size_t &out_size) {
+  MG_TRACE_SCOPE(TRACE_ENCODE, "nxgx_compress");
+  if (out_size < nxgx_compress_bound(in.size())) {
+    fprintf(stderr, "Output buffer too small\n");
+    return false;
+  }
+
   // Create stream context
   z_stream dstream{};
   dstream.avail_in = in.size();
   dstream.next_in =
       const_cast<uint8_t *>(reinterpret_cast<const uint8_t *>(in.data()));
 
-  // Default output to same size as input + size of header
-  out.resize(in.size() + sizeof(Nxx));
-
   // Set the output start to be past the end of the reserved header area
-  dstream.avail_out = out.size();
-  dstream.next_out = reinterpret_cast<uint8_t *>(out.data() + sizeof(Nxx));
+  dstream.avail_out = out_size - sizeof(Nxx);
+  dstream.next_out = out + sizeof(Nxx);
   dstream.total_out = 0;
 
   // Init deflate context
@@ -160,13 +270,14 @@ bool nxgx_compress(const std::string_view &in, std::string &out) {
 
   // Perform deflate
   int err = deflate(&dstream, Z_FINISH);
-  if (err != Z_OK && err != Z_STREAM_END) {
+  if (err != Z_STREAM_END) {
     fprintf(stderr, "zlib deflate error: %d: %s\n", err, dstream.msg);
+    deflateEnd(&dstream);
     return false;
   }
 
   // Get the final compressed size
-  const int compressed_size = dstream.total_out;
+  const size_t compressed_size = dstream.total_out;
 
   err = deflateEnd(&dstream);
   if (err != Z_OK && err != Z_STREAM_END) {
@@ -175,19 +286,19 @@ bool nxgx_compress(const std::string_view &in, std::string &out) {
   }
 
   // Write the header
-  Nxx *header = reinterpret_cast<Nxx *>(out.data());
+  Nxx *header = reinterpret_cast<Nxx *>(out);
   header->size = in.size();
   header->compressed_size = compressed_size;
+  header->_padding = 0;
   memcpy(header->magic, MAGIC_NXGX, sizeof(header->magic));
   header->to_file_order();
 
-  // Shrunk output buffer to wrap
-  out.resize(sizeof(Nxx) + compressed_size);
-
+  out_size = sizeof(Nxx) + compressed_size;
   return true;
 }
 
 bool nxcx_compress(const std::string_view &in, std::string &out) {
+  MG_TRACE_SCOPE(TRACE_ENCODE, "nxcx_compress");
   return false;
 }
 
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <mg/data/script.hpp>
+#include <mg/util/trace.hpp>
+
+namespace mg::data {
+
+namespace {
+
+bool is_name_char(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// _Z command addresses are written in lower case hex
+bool is_address_char(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+}
+
+// Commands that load assets, and which argument names the asset
+struct AssetCommand {
+  const char *name;
+  unsigned arg;
+  AssetKind kind;
+};
+const AssetCommand ASSET_COMMANDS[] = {
+    // _STCH(8,img2511,413,225,1000,0,3102,,CC,,,)
+    {"_STCH", 1, ASSET_IMAGE},
+    // _SEPL(1,0,MOON_SE02070,,`017:100)
+    {"_SEPL", 2, ASSET_SE},
+    // _VPLY(filename, ??)
+    {"_VPLY", 0, ASSET_VOICE},
+};
+
+const char *PAGE_COMMAND = "_PGST";
+
+} // namespace
+
+std::string_view ScriptCommand::arg(unsigned index) const {
+  size_t start = 0;
+  for (unsigned i = 0; i < index; i++) {
+    start = args.find(',', start);
+    if (start == std::string_view::npos) {
+      return std::string_view();
+    }
+    start++;
+  }
+  const size_t end = args.find(',', start);
+  return args.substr(start, end == std::string_view::npos ? end : end - start);
+}
+
+bool ScriptTokenizer::next(ScriptCommand &out) {
+  const char *const base = _script.data();
+  while (_pos < _script.size()) {
+    // Every command starts with an underscore
+    const char *underscore = static_cast<const char *>(
+        memchr(base + _pos, '_', _script.size() - _pos));
+    if (underscore == nullptr) {
+      break;
+    }
+    const size_t start = underscore - base;
+    _pos = start + 1;
+
+    // Either a _Z command with an address (_ZMb961f), or a four character
+    // name (_STCH). A plain name can also start with _Z and end in digits
+    // (_ZM12), so only take an address of more than two characters, or one
+    // with a hex letter in it.
+    size_t name_end = start + 3;
+    size_t address_end = name_end;
+    bool address_has_letter = false;
+    if (_script.size() - start >= 3 && base[start + 1] == 'Z' &&
+        base[start + 2] >= 'A' && base[start + 2] <= 'Z') {
+      while (address_end < _script.size() &&
+             is_address_char(base[address_end])) {
+        address_has_letter |= base[address_end] >= 'a';
+        address_end++;
+      }
+    }
+    if (!address_has_letter && address_end - name_end <= 2) {
+      name_end = start + 1;
+      while (name_end < _script.size() && name_end < start + 5 &&
+             is_name_char(base[name_end])) {
+        name_end++;
+      }
+      if (name_end != start + 5) {
+        continue;
+      }
+      address_end = name_end;
+    }
+
+    // Then the argument list
+    if (address_end >= _script.size() || base[address_end] != '(') {
+      continue;
+    }
+    const size_t args_start = address_end + 1;
+    const size_t args_end = _script.find(')', args_start);
+    if (args_end == std::string_view::npos) {
+      break;
+    }
+
+    out.name = _script.substr(start, name_end - start);
+    out.address = _script.substr(name_end, address_end - name_end);
+    out.args = _script.substr(args_start, args_end - args_start);
+    out.offset = start;
+
+    // Some commands are followed by a ':'
+    _pos = args_end + 1;
+    if (_pos < _script.size() && base[_pos] == ':') {
+      _pos++;
+    }
+    return true;
+  }
+
+  _pos = _script.size();
+  return false;
+}
+
+const char *asset_kind_name(AssetKind kind) {
+  switch (kind) {
+  case ASSET_IMAGE:
+    return "image";
+  case ASSET_SE:
+    return "se";
+  case ASSET_VOICE:
+    return "voice";
+  default:
+    return "unknown";
+  }
+}
+
+bool ScriptIndex::add_scene(const std::string &path,
+                            const std::string_view &script) {
+  // Scan outside of the lock
+  SceneInfo scene;
+  scene.path = path;
+  bool has_commands = false;
+  ScriptTokenizer tokenizer(script);
+  ScriptCommand command;
+  while (tokenizer.next(command)) {
+    has_commands = true;
+    if (command.name == PAGE_COMMAND) {
+      scene.pages.push_back(PageMark{
+          (uint32_t)command.offset,
+          (int32_t)strtol(std::string(command.arg(0)).c_str(), nullptr, 10)});
+      continue;
+    }
+    for (auto &asset_command : ASSET_COMMANDS) {
+      if (command.name != asset_command.name) {
+        continue;
+      }
+      const std::string_view name = command.arg(asset_command.arg);
+      if (!name.empty()) {
+        scene.assets.push_back(AssetRef{asset_command.kind, std::string(name),
+                                        (uint32_t)command.offset});
+      }
+      break;
+    }
+  }
+  if (!has_commands) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _scenes.emplace_back(std::move(scene));
+  return true;
+}
+
+void ScriptIndex::finalize() {
+  std::sort(_scenes.begin(), _scenes.end(),
+            [](const SceneInfo &a, const SceneInfo &b) {
+              return a.path < b.path;
+            });
+
+  // Uses are already in scene / offset order, so a stable sort by name keeps
+  // that order within each asset
+  _asset_uses.clear();
+  for (uint32_t i = 0; i < _scenes.size(); i++) {
+    for (uint32_t j = 0; j < _scenes[i].assets.size(); j++) {
+      _asset_uses.push_back(AssetUse{i, j});
+    }
+  }
+  std::stable_sort(_asset_uses.begin(), _asset_uses.end(),
+                   [&](const AssetUse &a, const AssetUse &b) {
+                     return asset(a).name < asset(b).name;
+                   });
+}
+
+const SceneInfo *ScriptIndex::find_scene(const std::string_view &path) const {
+  auto it = std::lower_bound(
+      _scenes.begin(), _scenes.end(), path,
+      [](const SceneInfo &scene, const std::string_view &path) {
+        return scene.path < path;
+      });
+  return it != _scenes.end() && it->path == path ? &*it : nullptr;
+}
+
+std::vector<ScriptIndex::AssetUse>
+ScriptIndex::find_asset(const std::string_view &name) const {
+  auto range = std::equal_range(
+      _asset_uses.begin(), _asset_uses.end(), name,
+      [&](const auto &a, const auto &b) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(a)>, AssetUse>) {
+          return std::string_view(asset(a).name) < b;
+        } else {
+          return a < std::string_view(asset(b).name);
+        }
+      });
+  return std::vector<AssetUse>(range.first, range.second);
+}
+
+bool script_index_build(const char *path, ScriptIndex &out,
+                        const WalkOptions &options) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "script_index_build");
+  // Scripts are plain text, so only unrecognised payloads are candidates
+  const bool ok = walk(
+      path,
+      [&](const std::string &path, Format format,
+          const std::string_view &data) {
+        if (format == FORMAT_UNKNOWN) {
+          out.add_scene(path, data);
+        }
+      },
+      options);
+  out.finalize();
+  return ok;
+}
+
+} // namespace mg::data
@@ -0,0 +1,172 @@
+#include <errno.h>
+#include <iconv.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+
+#include <mg/data/search.hpp>
+#include <mg/util/trace.hpp>
+
+namespace mg::data {
+
+namespace {
+
+bool utf8_to_shift_jis(const std::string &in, std::string &out) {
+  // The game's text is in the Windows flavour of Shift-JIS
+  iconv_t cd = iconv_open("CP932", "UTF-8");
+  if (cd == (iconv_t)-1) {
+    fprintf(stderr, "Failed to open UTF-8 to Shift-JIS converter: %s\n",
+            strerror(errno));
+    return false;
+  }
+
+  // Shift-JIS never needs more bytes than UTF-8 for the same text
+  out.resize(in.size());
+  char *in_ptr = const_cast<char *>(in.data());
+  size_t in_left = in.size();
+  char *out_ptr = out.data();
+  size_t out_left = out.size();
+  const size_t ret = iconv(cd, &in_ptr, &in_left, &out_ptr, &out_left);
+  iconv_close(cd);
+  if (ret == (size_t)-1) {
+    return false;
+  }
+  out.resize(out.size() - out_left);
+  return true;
+}
+
+} // namespace
+
+bool search_patterns_for_text(const std::string &text,
+                              std::vector<SearchPattern> &out) {
+  if (text.empty()) {
+    return false;
+  }
+  out.push_back(SearchPattern{text, text});
+
+  // Text with characters outside CP932 can still be found as UTF-8
+  std::string sjis;
+  if (!utf8_to_shift_jis(text, sjis)) {
+    fprintf(stderr, "Searching for '%s' as UTF-8 only, as it cannot be "
+                    "encoded as Shift-JIS\n",
+            text.c_str());
+  } else if (sjis != text) {
+    out.push_back(SearchPattern{text + " (Shift-JIS)", sjis});
+  }
+  return true;
+}
+
+MultiSearcher::MultiSearcher(std::vector<SearchPattern> patterns)
+    : _patterns(std::move(patterns)) {
+  for (auto &pattern : _patterns) {
+    _max_length = std::max(_max_length, pattern.bytes.size());
+  }
+}
+
+void MultiSearcher::scan(
+    const std::string_view &data,
+    const std::function<void(size_t offset, unsigned pattern)> &found) const {
+  const char *const base = data.data();
+  size_t pos = 0;
+
+#ifdef __SSE2__
+  // Compare 16 candidate start positions at once against the first and last
+  // byte of each pattern. Stop while the last byte of the longest pattern at
+  // the last candidate is still in bounds.
+  struct Prefilter {
+    __m128i first;
+    __m128i last;
+  };
+  std::vector<Prefilter> prefilters;
+  for (auto &pattern : _patterns) {
+    prefilters.push_back(Prefilter{_mm_set1_epi8(pattern.bytes.front()),
+                                   _mm_set1_epi8(pattern.bytes.back())});
+  }
+
+  for (; pos + _max_length + 15 <= data.size(); pos += 16) {
+    const __m128i block_first =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + pos));
+    for (unsigned i = 0; i < _patterns.size(); i++) {
+      const std::string &pattern = _patterns[i].bytes;
+      const __m128i block_last = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(base + pos + pattern.size() - 1));
+      unsigned mask = _mm_movemask_epi8(
+          _mm_and_si128(_mm_cmpeq_epi8(block_first, prefilters[i].first),
+                        _mm_cmpeq_epi8(block_last, prefilters[i].last)));
+      while (mask != 0) {
+        const size_t offset = pos + __builtin_ctz(mask);
+        if (!memcmp(base + offset, pattern.data(), pattern.size())) {
+          found(offset, i);
+        }
+        mask &= mask - 1;
+      }
+    }
+  }
+#endif
+
+  // Remaining start positions, one pattern at a time
+  for (unsigned i = 0; i < _patterns.size(); i++) {
+    const std::string &pattern = _patterns[i].bytes;
+    size_t offset = pos;
+    while (offset + pattern.size() <= data.size()) {
+      const char *candidate = static_cast<const char *>(
+          memchr(base + offset, pattern.front(),
+                 data.size() - pattern.size() + 1 - offset));
+      if (candidate == nullptr) {
+        break;
+      }
+      offset = candidate - base;
+      if (!memcmp(candidate, pattern.data(), pattern.size())) {
+        found(offset, i);
+      }
+      offset++;
+    }
+  }
+}
+
+bool search_archive(const char *path, const MultiSearcher &searcher,
+                    const std::function<void(const SearchHit &)> &found,
+                    const WalkOptions &options, SearchStats *stats) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "search_archive");
+  std::atomic<uint64_t> payloads{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> hits{0};
+
+  const bool ok = walk(
+      path,
+      [&](const std::string &path, Format format,
+          const std::string_view &data) {
+        // Containers are searched through their entries, and compressed data
+        // through its decoded child
+        const bool is_compressed = format == FORMAT_MZX ||
+                                   format == FORMAT_NXGX ||
+                                   format == FORMAT_NXCX;
+        if (format != FORMAT_UNKNOWN &&
+            !(is_compressed && !options.decompress)) {
+          return;
+        }
+
+        payloads.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(data.size(), std::memory_order_relaxed);
+        searcher.scan(data, [&](size_t offset, unsigned pattern) {
+          hits.fetch_add(1, std::memory_order_relaxed);
+          found(SearchHit{path, offset, pattern});
+        });
+      },
+      options);
+
+  if (stats != nullptr) {
+    stats->payloads = payloads;
+    stats->bytes = bytes;
+    stats->hits = hits;
+  }
+  return ok && !(options.progress && options.progress->is_cancelled());
+}
+
+} // namespace mg::data
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <mg/data/string_table.hpp>
+#include <mg/util/endian.hpp>
+#include <mg/util/trace.hpp>
+
+namespace mg::data {
+
+// Position of the first \r\n at or after `start`, or npos
+static size_t find_terminator(const std::string_view &data, size_t start) {
+  const char *const base = data.data();
+  size_t pos = start;
+#ifdef __SSE2__
+  // Compare 16 candidate \r positions per step against the following bytes.
+  // The second load reads one byte ahead, so stop 17 bytes from the end.
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  for (; data.size() - pos >= 17; pos += 16) {
+    const __m128i cur =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + pos));
+    const __m128i next =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + pos + 1));
+    const uint32_t mask =
+        _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(cur, cr),
+                                        _mm_cmpeq_epi8(next, lf)));
+    if (mask) {
+      return pos + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; pos + 1 < data.size(); pos++) {
+    if (base[pos] == '\r' && base[pos + 1] == '\n') {
+      return pos;
+    }
+  }
+  return std::string_view::npos;
+}
+
+void string_table_swap_offsets(uint32_t *offsets, size_t count) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  size_t i = 0;
+#ifdef __SSE2__
+  // SSE2 has no byte shuffle, so swap with 16 bit rotates: first the bytes
+  // within each half, then the two halves
+  for (; count - i >= 4; i += 4) {
+    __m128i *p = reinterpret_cast<__m128i *>(offsets + i);
+    __m128i v = _mm_loadu_si128(p);
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+    _mm_storeu_si128(p, v);
+  }
+#endif
+  for (; i < count; i++) {
+    offsets[i] = __builtin_bswap32(offsets[i]);
+  }
+#endif
+}
+
+void string_table_read_offsets(const std::string_view &offset_table,
+                               std::vector<uint32_t> &out) {
+  // Copy out in bulk, swap, then trim at the terminator
+  out.resize(offset_table.size() / sizeof(uint32_t));
+  memcpy(out.data(), offset_table.data(), out.size() * sizeof(uint32_t));
+  string_table_swap_offsets(out.data(), out.size());
+  for (size_t i = 0; i < out.size(); i++) {
+    if (out[i] == StringTable::END_OF_TABLE) {
+      out.resize(i);
+      break;
+    }
+  }
+}
+
+void string_table_read(const std::string_view &offset_table,
+                       const std::string_view &string_data,
+                       std::vector<std::string_view> &out) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "string_table_read");
+  std::vector<uint32_t> offsets;
+  string_table_read_offsets(offset_table, offsets);
+
+  out.clear();
+  out.reserve(offsets.size());
+  for (uint32_t offset : offsets) {
+    if (offset == string_data.size()) {
+      continue;
+    }
+
+    const size_t end = offset < string_data.size()
+                           ? find_terminator(string_data, offset)
+                           : std::string_view::npos;
+    if (end == std::string_view::npos) {
+      fprintf(stderr, "Warning - failed to load string at offset %08x\n",
+              offset);
+      continue;
+    }
+    out.emplace_back(string_data.substr(offset, end - offset));
+  }
+}
+
+void string_table_write(const std::vector<std::string_view> &strings,
+                        std::string &offset_table, std::string &string_data) {
+  MG_TRACE_SCOPE(TRACE_ENCODE, "string_table_write");
+  // Size both outputs up front
+  size_t string_data_size = 0;
+  for (auto &string : strings) {
+    string_data_size += string.size() + 2;
+  }
+  const size_t offset_count = strings.size() + StringTable::END_OF_DATA_COUNT +
+                              StringTable::END_OF_TABLE_COUNT;
+  string_data.resize(string_data_size);
+  offset_table.resize(offset_count * sizeof(uint32_t));
+
+  // Lay out the strings, recording offsets in host order
+  uint32_t *offsets = reinterpret_cast<uint32_t *>(&offset_table[0]);
+  char *write_ptr = &string_data[0];
+  size_t offset_idx = 0;
+  for (auto &string : strings) {
+    offsets[offset_idx++] = write_ptr - string_data.data();
+    memcpy(write_ptr, string.data(), string.size());
+    write_ptr += string.size();
+    *write_ptr++ = '\r';
+    *write_ptr++ = '\n';
+  }
+
+  // For some reason, the offsets seem to include 2 instances of offsets that
+  // point to the final byte of the string table. Recreate them here in case
+  // the game actually needs this info.
+  for (unsigned i = 0; i < StringTable::END_OF_DATA_COUNT; i++) {
+    offsets[offset_idx++] = string_data_size;
+  }
+  for (unsigned i = 0; i < StringTable::END_OF_TABLE_COUNT; i++) {
+    offsets[offset_idx++] = StringTable::END_OF_TABLE;
+  }
+
+  string_table_swap_offsets(offsets, offset_count);
+}
+
+} // namespace mg::data
@@ -0,0 +1,429 @@
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+
+#include <json.hpp>
+
+#include <mg/data/translation_index.hpp>
+#include <mg/util/endian.hpp>
+#include <mg/util/json.hpp>
+#include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
+
+namespace mg::data {
+
+void TranslationIndex::FileHeader::to_host_order() {
+  language_count = le_to_host_u32(language_count);
+  entry_count = le_to_host_u32(entry_count);
+  string_data_size = le_to_host_u64(string_data_size);
+}
+void TranslationIndex::FileHeader::to_file_order() {
+  language_count = host_to_le_u32(language_count);
+  entry_count = host_to_le_u32(entry_count);
+  string_data_size = host_to_le_u64(string_data_size);
+}
+
+std::unique_ptr<MappedTranslationIndex> MappedTranslationIndex::parse(
+    std::shared_ptr<mg::fs::MappedFile> backing_data) {
+  return parse(backing_data->string_view(), backing_data);
+}
+
+std::unique_ptr<MappedTranslationIndex> MappedTranslationIndex::parse(
+    std::string_view data, std::shared_ptr<mg::fs::MappedFile> backing_data) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "MappedTranslationIndex::parse");
+  // Is data large enough to have a header
+  if (data.size() < sizeof(TranslationIndex::FileHeader)) {
+    fprintf(stderr, "Translation index too short to read header\n");
+    return nullptr;
+  }
+
+  // Read off header
+  TranslationIndex::FileHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+  header.to_host_order();
+
+  // Valid magic?
+  if (memcmp(header.magic, TranslationIndex::FILE_MAGIC,
+             sizeof(header.magic)) != 0) {
+    fprintf(stderr, "Translation index has invalid magic\n");
+    return nullptr;
+  }
+
+  // Check the language list, entry table and string data all fit. Individual
+  // string refs are checked on lookup, so that opening stays O(1).
+  const size_t languages_offset = sizeof(TranslationIndex::FileHeader);
+  const size_t entries_offset =
+      languages_offset +
+      (size_t)header.language_count * TranslationIndex::LANGUAGE_NAME_SIZE;
+  const size_t string_data_offset =
+      entries_offset + (size_t)header.entry_count *
+                           TranslationIndex::entry_size(header.language_count);
+  if (header.language_count > UINT16_MAX ||
+      data.size() < string_data_offset ||
+      data.size() - string_data_offset < header.string_data_size) {
+    fprintf(stderr, "Translation index too short for %u entries\n",
+            header.entry_count);
+    return nullptr;
+  }
+
+  std::vector<std::string> languages;
+  for (uint32_t i = 0; i < header.language_count; i++) {
+    const char *name = data.data() + languages_offset +
+                       i * TranslationIndex::LANGUAGE_NAME_SIZE;
+    languages.emplace_back(
+        name, strnlen(name, TranslationIndex::LANGUAGE_NAME_SIZE));
+  }
+
+  return std::unique_ptr<MappedTranslationIndex>(new MappedTranslationIndex(
+      backing_data, languages,
+      reinterpret_cast<const uint8_t *>(data.data() + entries_offset),
+      header.entry_count,
+      data.substr(string_data_offset, header.string_data_size)));
+}
+
+int MappedTranslationIndex::language_index(
+    const std::string_view &language) const {
+  for (unsigned i = 0; i < _languages.size(); i++) {
+    if (_languages[i] == language) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool MappedTranslationIndex::find(const std::string_view &digest,
+                                  unsigned language,
+                                  std::string_view &out) const {
+  if (digest.size() != TranslationIndex::DIGEST_SIZE ||
+      language >= _languages.size()) {
+    return false;
+  }
+
+  // Binary search the sorted entry table
+  uint32_t lo = 0;
+  uint32_t hi = _entry_count;
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo) / 2;
+    const uint8_t *entry = _entries + mid * _entry_size;
+    const int cmp =
+        memcmp(entry, digest.data(), TranslationIndex::DIGEST_SIZE);
+    if (cmp < 0) {
+      lo = mid + 1;
+      continue;
+    }
+    if (cmp > 0) {
+      hi = mid;
+      continue;
+    }
+
+    // Found it, check the string lies within the string data
+    TranslationIndex::StringRef ref;
+    memcpy(&ref,
+           entry + TranslationIndex::DIGEST_SIZE +
+               language * sizeof(TranslationIndex::StringRef),
+           sizeof(ref));
+    const uint32_t offset = le_to_host_u32(ref.offset);
+    const uint32_t size = le_to_host_u32(ref.size);
+    if (offset > _string_data.size() || _string_data.size() - offset < size) {
+      fprintf(stderr, "Translation index string ref out of range\n");
+      return false;
+    }
+    if (size == 0) {
+      return false;
+    }
+    out = _string_data.substr(offset, size);
+    return true;
+  }
+
+  return false;
+}
+
+bool translation_index_write(const std::vector<std::string> &languages,
+                             std::vector<TranslationRecord> &records,
+                             std::string &out) {
+  MG_TRACE_SCOPE(TRACE_ENCODE, "translation_index_write");
+  for (auto &language : languages) {
+    if (language.size() > TranslationIndex::LANGUAGE_NAME_SIZE) {
+      fprintf(stderr, "Language name '%s' too long for translation index\n",
+              language.c_str());
+      return false;
+    }
+  }
+  for (auto &record : records) {
+    if (record.digest.size() != TranslationIndex::DIGEST_SIZE) {
+      fprintf(stderr, "Malformed translation record\n");
+      return false;
+    }
+  }
+
+  // Sort by digest and drop duplicates
+  std::stable_sort(records.begin(), records.end(),
+                   [](const TranslationRecord &a, const TranslationRecord &b) {
+                     return a.digest < b.digest;
+                   });
+  records.erase(std::unique(records.begin(), records.end(),
+                            [](const TranslationRecord &a,
+                               const TranslationRecord &b) {
+                              return a.digest == b.digest;
+                            }),
+                records.end());
+
+  // Size everything up front so the output is written in one pass
+  size_t string_data_size = 0;
+  for (auto &record : records) {
+    for (size_t i = 0; i < languages.size(); i++) {
+      string_data_size += record.text[i].size();
+    }
+  }
+  if (string_data_size > UINT32_MAX || records.size() > UINT32_MAX) {
+    fprintf(stderr, "Translation DB too large for index\n");
+    return false;
+  }
+  const size_t entry_size = TranslationIndex::entry_size(languages.size());
+  const size_t string_data_offset =
+      sizeof(TranslationIndex::FileHeader) +
+      languages.size() * TranslationIndex::LANGUAGE_NAME_SIZE +
+      records.size() * entry_size;
+  out.clear();
+  out.resize(string_data_offset + string_data_size);
+  char *write_ptr = &out[0];
+
+  // Header
+  TranslationIndex::FileHeader header;
+  memcpy(header.magic, TranslationIndex::FILE_MAGIC, sizeof(header.magic));
+  header.language_count = languages.size();
+  header.entry_count = records.size();
+  header.string_data_size = string_data_size;
+  header.to_file_order();
+  memcpy(write_ptr, &header, sizeof(header));
+  write_ptr += sizeof(header);
+
+  // Language names. The output is already zeroed, so padding is implicit.
+  for (auto &language : languages) {
+    memcpy(write_ptr, language.data(), language.size());
+    write_ptr += TranslationIndex::LANGUAGE_NAME_SIZE;
+  }
+
+  // Entries and their strings
+  uint32_t string_write_offset = 0;
+  for (auto &record : records) {
+    memcpy(write_ptr, record.digest.data(), TranslationIndex::DIGEST_SIZE);
+    write_ptr += TranslationIndex::DIGEST_SIZE;
+    for (size_t i = 0; i < languages.size(); i++) {
+      const std::string_view &text = record.text[i];
+      TranslationIndex::StringRef ref;
+      ref.offset = host_to_le_u32(string_write_offset);
+      ref.size = host_to_le_u32(text.size());
+      memcpy(write_ptr, &ref, sizeof(ref));
+      write_ptr += sizeof(ref);
+
+      memcpy(&out[string_data_offset + string_write_offset], text.data(),
+             text.size());
+      string_write_offset += text.size();
+    }
+  }
+
+  return true;
+}
+
+namespace {
+
+// Compile through the generic nlohmann::json DOM
+bool compile_json_dom(const std::string_view &json, std::string &out) {
+  nlohmann::json db = nlohmann::json::parse(json, nullptr, false);
+  if (db.is_discarded() || !db.is_object()) {
+    fprintf(stderr, "Failed to parse translation DB JSON\n");
+    return false;
+  }
+  auto script_text_by_hash = db.find("script_text_by_hash");
+  if (script_text_by_hash == db.end() || !script_text_by_hash->is_object()) {
+    fprintf(stderr, "Translation DB has no script_text_by_hash object\n");
+    return false;
+  }
+
+  // Collect the set of languages used by any line
+  std::map<std::string, unsigned> language_indices;
+  for (auto &line : script_text_by_hash->items()) {
+    if (!line.value().is_object()) {
+      continue;
+    }
+    for (auto &text : line.value().items()) {
+      language_indices.emplace(text.key(), 0);
+    }
+  }
+  std::vector<std::string> languages;
+  for (auto &language : language_indices) {
+    language.second = languages.size();
+    languages.push_back(language.first);
+  }
+
+  // Build records that point back into the parsed DB
+  std::vector<std::string> digests;
+  digests.reserve(script_text_by_hash->size());
+  std::vector<std::string_view> text;
+  text.reserve(script_text_by_hash->size() * languages.size());
+  std::vector<TranslationRecord> records;
+  records.reserve(script_text_by_hash->size());
+  for (auto &line : script_text_by_hash->items()) {
+    std::string digest;
+    if (!mg::string::hex_to_bytes(line.key(), digest) ||
+        digest.size() != TranslationIndex::DIGEST_SIZE) {
+      fprintf(stderr, "Skipping malformed line hash '%s'\n",
+              line.key().c_str());
+      continue;
+    }
+    if (!line.value().is_object()) {
+      continue;
+    }
+
+    digests.emplace_back(std::move(digest));
+    const size_t text_start = text.size();
+    text.resize(text_start + languages.size());
+    for (auto &field : line.value().items()) {
+      if (field.value().is_string()) {
+        text[text_start + language_indices[field.key()]] =
+            field.value().get_ref<const std::string &>();
+      }
+    }
+    records.push_back(TranslationRecord{digests.back(), &text[text_start]});
+  }
+
+  return translation_index_write(languages, records, out);
+}
+
+// Compile a DB of exactly the usual shape, without building a DOM. Strings
+// are used in place where possible, and only strings with escapes are copied
+// into an arena. Returns false, having output nothing, if the JSON is
+// malformed (including invalid UTF-8) or shaped in any other way.
+bool compile_json_fast(const std::string_view &json, std::string &out) {
+  mg::util::Arena arena;
+  size_t pos = 0;
+  std::string_view key;
+  if (!mg::json::consume(json, pos, '{') ||
+      !mg::json::parse_string(json, pos, arena, key) ||
+      key != "script_text_by_hash" || !mg::json::consume(json, pos, ':') ||
+      !mg::json::consume(json, pos, '{')) {
+    return false;
+  }
+
+  // Languages in order of appearance. Text is stored in one flat array, one
+  // slot per language per line, and is re-strided when a new language
+  // appears.
+  std::vector<std::string_view> languages;
+  std::vector<std::string_view> digests;
+  std::vector<std::string_view> text;
+  auto language_index = [&](const std::string_view &language) -> size_t {
+    for (size_t i = 0; i < languages.size(); i++) {
+      if (languages[i] == language) {
+        return i;
+      }
+    }
+    const size_t old_stride = languages.size();
+    languages.push_back(language);
+    std::vector<std::string_view> widened(digests.size() * languages.size());
+    for (size_t line = 0; line < digests.size(); line++) {
+      for (size_t i = 0; i < old_stride; i++) {
+        widened[line * languages.size() + i] = text[line * old_stride + i];
+      }
+    }
+    text.swap(widened);
+    return languages.size() - 1;
+  };
+
+  std::vector<std::string_view> malformed_keys;
+  std::vector<std::pair<size_t, std::string_view>> fields;
+  std::string digest;
+  bool done = mg::json::consume(json, pos, '}');
+  while (!done) {
+    // Each line is a hash key and an object of language -> text
+    if (!mg::json::parse_string(json, pos, arena, key) ||
+        !mg::json::consume(json, pos, ':') ||
+        !mg::json::consume(json, pos, '{')) {
+      return false;
+    }
+    fields.clear();
+    bool line_done = mg::json::consume(json, pos, '}');
+    while (!line_done) {
+      std::string_view language;
+      std::string_view value;
+      if (!mg::json::parse_string(json, pos, arena, language) ||
+          !mg::json::consume(json, pos, ':') ||
+          !mg::json::parse_string(json, pos, arena, value)) {
+        return false;
+      }
+      fields.emplace_back(language_index(language), value);
+      if (mg::json::consume(json, pos, '}')) {
+        line_done = true;
+      } else if (!mg::json::consume(json, pos, ',')) {
+        return false;
+      }
+    }
+
+    if (mg::string::hex_to_bytes(key, digest) &&
+        digest.size() == TranslationIndex::DIGEST_SIZE) {
+      digests.push_back(arena.copy(digest));
+      text.resize(digests.size() * languages.size());
+      for (auto &field : fields) {
+        text[(digests.size() - 1) * languages.size() + field.first] =
+            field.second;
+      }
+    } else {
+      malformed_keys.push_back(key);
+    }
+
+    if (mg::json::consume(json, pos, '}')) {
+      done = true;
+    } else if (!mg::json::consume(json, pos, ',')) {
+      return false;
+    }
+  }
+  if (!mg::json::consume(json, pos, '}')) {
+    return false;
+  }
+  mg::json::skip_whitespace(json, pos);
+  if (pos != json.size()) {
+    return false;
+  }
+
+  for (auto &malformed_key : malformed_keys) {
+    fprintf(stderr, "Skipping malformed line hash '%.*s'\n",
+            (int)malformed_key.size(), malformed_key.data());
+  }
+
+  // Languages are stored sorted by name
+  std::vector<size_t> language_order(languages.size());
+  for (size_t i = 0; i < language_order.size(); i++) {
+    language_order[i] = i;
+  }
+  std::sort(language_order.begin(), language_order.end(),
+            [&](size_t a, size_t b) { return languages[a] < languages[b]; });
+  std::vector<std::string> sorted_languages;
+  for (size_t i : language_order) {
+    sorted_languages.emplace_back(languages[i]);
+  }
+  std::vector<std::string_view> sorted_text(text.size());
+  std::vector<TranslationRecord> records(digests.size());
+  for (size_t line = 0; line < digests.size(); line++) {
+    const size_t base = line * languages.size();
+    for (size_t i = 0; i < language_order.size(); i++) {
+      sorted_text[base + i] = text[base + language_order[i]];
+    }
+    // Where a key is repeated, the last occurrence wins, as with the DOM. The
+    // writer keeps the first of each digest, so hand it the lines in reverse.
+    records[digests.size() - 1 - line] =
+        TranslationRecord{digests[line], &sorted_text[base]};
+  }
+
+  return translation_index_write(sorted_languages, records, out);
+}
+
+} // namespace
+
+bool translation_index_compile_json(const std::string_view &json,
+                                    std::string &out) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "translation_index_compile_json");
+  return compile_json_fast(json, out) || compile_json_dom(json, out);
+}
+
+} // namespace mg::data
@@ -0,0 +1,237 @@
+#include <string.h>
+
+#include <filesystem>
+
+#include <mg/data/hfa.hpp>
+#include <mg/data/mrg.hpp>
+#include <mg/data/mzp.hpp>
+#include <mg/data/mzx.hpp>
+#include <mg/data/nam.hpp>
+#include <mg/data/nxx.hpp>
+#include <mg/data/walk.hpp>
+#include <mg/util/fs.hpp>
+#include <mg/util/string.hpp>
+#include <mg/util/thread_pool.hpp>
+#include <mg/util/trace.hpp>
+
+namespace mg::data {
+
+const char *format_name(Format format) {
+  switch (format) {
+  case FORMAT_MRG:
+    return "MRG";
+  case FORMAT_MZP:
+    return "MZP";
+  case FORMAT_MZX:
+    return "MZX";
+  case FORMAT_NXGX:
+    return "NXGX";
+  case FORMAT_NXCX:
+    return "NXCX";
+  case FORMAT_HFA:
+    return "HFA";
+  default:
+    return "RAW";
+  }
+}
+
+Format sniff_format(const std::string_view &data) {
+  auto has_magic = [&](const char *magic) {
+    const size_t len = strlen(magic);
+    return data.size() >= len && !memcmp(data.data(), magic, len);
+  };
+
+  if (has_magic(Mzp::FILE_MAGIC)) {
+    return FORMAT_MZP;
+  }
+  if (has_magic(MzxHeader::FILE_MAGIC)) {
+    return FORMAT_MZX;
+  }
+  if (has_magic("NXGX") && data.size() >= sizeof(Nxx)) {
+    return FORMAT_NXGX;
+  }
+  if (has_magic("NXCX") && data.size() >= sizeof(Nxx)) {
+    return FORMAT_NXCX;
+  }
+  if (has_magic(Hfa::MAGIC)) {
+    return FORMAT_HFA;
+  }
+  return FORMAT_UNKNOWN;
+}
+
+namespace {
+
+struct WalkContext {
+  const WalkVisitor &visitor;
+  const WalkOptions &options;
+  mg::util::ThreadPool &pool;
+};
+
+// A payload to visit. The owner keeps whatever buffer `data` points into
+// alive until this node and all of its children have been visited.
+struct Node {
+  std::string path;
+  std::string_view data;
+  std::shared_ptr<const void> owner;
+  unsigned depth;
+};
+
+void visit(const WalkContext &ctx, const Node &node);
+
+void submit(const WalkContext &ctx, Node node) {
+  ctx.pool.submit([&ctx, node = std::move(node)]() { visit(ctx, node); });
+}
+
+void submit_child(const WalkContext &ctx, const Node &parent,
+                  const std::string &name, std::string_view data,
+                  std::shared_ptr<const void> owner) {
+  submit(ctx, Node{parent.path + "/" + name, data, owner, parent.depth + 1});
+}
+
+void visit(const WalkContext &ctx, const Node &node) {
+  if (ctx.options.progress != nullptr) {
+    if (ctx.options.progress->is_cancelled()) {
+      return;
+    }
+    ctx.options.progress->done.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const Format format = sniff_format(node.data);
+  ctx.visitor(node.path, format, node.data);
+  if (node.depth >= ctx.options.max_depth) {
+    return;
+  }
+
+  switch (format) {
+  case FORMAT_MZP: {
+    auto mzp = MappedMzp::parse(node.data);
+    if (mzp == nullptr) {
+      return;
+    }
+    for (unsigned i = 0; i < mzp->entries().size(); i++) {
+      submit_child(ctx, node, mg::string::format("%u", i), mzp->entry_data(i),
+                   node.owner);
+    }
+  } break;
+
+  case FORMAT_HFA: {
+    auto hfa = MappedHfa::parse(node.data);
+    if (hfa == nullptr) {
+      return;
+    }
+    for (unsigned i = 0; i < hfa->entries().size(); i++) {
+      const auto &entry = hfa->entries()[i];
+      const std::string name(entry.filename,
+                             strnlen(entry.filename, sizeof(entry.filename)));
+      submit_child(ctx, node, name, hfa->entry_data(i), node.owner);
+    }
+  } break;
+
+  case FORMAT_MZX:
+  case FORMAT_NXGX:
+  case FORMAT_NXCX: {
+    if (!ctx.options.decompress) {
+      return;
+    }
+
+    // The decoded buffer belongs to the child, and is released as soon as it
+    // and its own children are done
+    auto decoded = std::make_shared<std::string>();
+    const bool ok = format == FORMAT_MZX
+                        ? mzx_decompress(node.data, *decoded)
+                        : nxx_decompress(node.data, *decoded);
+    if (!ok) {
+      return;
+    }
+    submit_child(ctx, node, "decoded", *decoded, decoded);
+  } break;
+
+  default:
+    break;
+  }
+}
+
+bool walk_mrg(const WalkContext &ctx, const std::string &root_path,
+              const std::string &basename) {
+  // Read raw data for hed file
+  const std::string hed_filename =
+      mg::string::format("%s.hed", basename.c_str());
+  std::string hed_raw;
+  if (!mg::fs::read_file(hed_filename.c_str(), hed_raw)) {
+    return false;
+  }
+
+  // Map the mrg data
+  const std::string mrg_filename =
+      mg::string::format("%s.mrg", basename.c_str());
+  std::shared_ptr<mg::fs::MappedFile> mrg_data =
+      mg::fs::MappedFile::open(mrg_filename.c_str());
+  if (mrg_data == nullptr) {
+    fprintf(stderr, "Failed to open '%s'\n", mrg_filename.c_str());
+    return false;
+  }
+  auto mrg = MappedMrg::parse(hed_raw, mrg_data);
+  if (mrg == nullptr) {
+    return false;
+  }
+
+  // Names are optional
+  const std::string nam_filename =
+      mg::string::format("%s.nam", basename.c_str());
+  std::shared_ptr<mg::fs::MappedFile> nam_data =
+      std::filesystem::exists(nam_filename)
+          ? mg::fs::MappedFile::open(nam_filename.c_str())
+          : nullptr;
+  std::unique_ptr<NamView> nam = nam_data ? NamView::parse(nam_data) : nullptr;
+  const bool has_nam =
+      nam != nullptr && nam->names().size() == mrg->entries().size();
+
+  Node root{root_path, mrg_data->string_view(), mrg_data, 0};
+  if (ctx.options.progress != nullptr) {
+    ctx.options.progress->done.fetch_add(1, std::memory_order_relaxed);
+  }
+  ctx.visitor(root.path, FORMAT_MRG, root.data);
+  for (unsigned i = 0; i < mrg->entries().size(); i++) {
+    const std::string name =
+        has_nam ? mg::string::format("%u.%.*s", i, (int)nam->names()[i].size(),
+                                     nam->names()[i].data())
+                : mg::string::format("%u", i);
+    submit_child(ctx, root, name, mrg->entry_data(i), mrg_data);
+  }
+
+  return true;
+}
+
+} // namespace
+
+bool walk(const char *path, const WalkVisitor &visitor,
+          const WalkOptions &options) {
+  MG_TRACE_SCOPE(TRACE_PARSE, "walk");
+  mg::util::ThreadPool pool(options.thread_count);
+  WalkContext ctx{visitor, options, pool};
+
+  // Is this an MRG? Accept either the basename or the .mrg itself
+  std::filesystem::path fs_path(path);
+  std::string mrg_basename = path;
+  if (fs_path.extension() == ".mrg") {
+    mrg_basename = fs_path.replace_extension("").string();
+  }
+  if (std::filesystem::exists(mrg_basename + ".hed") &&
+      std::filesystem::exists(mrg_basename + ".mrg")) {
+    const bool ok = walk_mrg(ctx, path, mrg_basename);
+    pool.wait_idle();
+    return ok;
+  }
+
+  // Otherwise map it and let the format sniffing decide
+  std::shared_ptr<mg::fs::MappedFile> data = mg::fs::MappedFile::open(path);
+  if (data == nullptr) {
+    fprintf(stderr, "Failed to open '%s'\n", path);
+    return false;
+  }
+  submit(ctx, Node{path, data->string_view(), data, 0});
+  pool.wait_idle();
+  return true;
+}
+
+} // namespace mg::data
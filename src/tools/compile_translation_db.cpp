@@ -0,0 +1,37 @@
+#include <mg/data/translation_index.hpp>
+#include <mg/util/fs.hpp>
+#include <mg/util/trace.hpp>
+
+int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "compile_translation_db");
+  if (argc != 3) {
+    fprintf(stderr, "%s translation_db.json translation_db.idx\n", argv[0]);
+    return -1;
+  }
+
+  // Name args
+  const char *translation_db_filename = argv[1];
+  const char *output_filename = argv[2];
+
+  // Map the JSON DB
+  std::shared_ptr<mg::fs::MappedFile> translation_db_raw =
+      mg::fs::MappedFile::open(translation_db_filename);
+  if (translation_db_raw == nullptr) {
+    fprintf(stderr, "Failed to read translation db from '%s'\n",
+            translation_db_filename);
+    return -1;
+  }
+
+  // Compile and emit
+  std::string index;
+  if (!mg::data::translation_index_compile_json(
+          translation_db_raw->string_view(), index)) {
+    return -1;
+  }
+  if (!mg::fs::write_file(output_filename, index)) {
+    fprintf(stderr, "Failed to write '%s'\n", output_filename);
+    return -1;
+  }
+
+  return 0;
+}
@@ -1,4 +1,8 @@
 #include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <filesystem>
 
 #include <GL/gl.h>
 #include <GLFW/glfw3.h>
@@ -8,12 +12,19 @@
 #include <imgui_impl_opengl2.h>
 #include <imgui_memory_editor.h>
 
+#include <mg/data/hfa.hpp>
+#include <mg/data/mrg.hpp>
 #include <mg/data/mzp.hpp>
 #include <mg/data/mzx.hpp>
 #include <mg/data/nam.hpp>
-#include <mg/util/endian.hpp>
+#include <mg/data/nxx.hpp>
+#include <mg/data/search.hpp>
+#include <mg/data/string_table.hpp>
 #include <mg/util/fs.hpp>
+#include <mg/util/progress.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/thread_pool.hpp>
+#include <mg/util/trace.hpp>
 
 enum DataType {
   UNDEFINED,
@@ -22,58 +33,396 @@ enum DataType {
   DATA_MZX,
   DATA_HEXDUMP,
   DATA_STRING_TABLE,
+  DATA_MRG,
+  DATA_HFA,
+  DATA_NXX,
+  DATA_TYPE_COUNT,
+};
+
+enum ParseState {
+  PARSE_NONE,
+  PARSE_PENDING,
+  PARSE_CANCELLED,
+  PARSE_DONE,
+};
+
+// Output of a parse job. Only the fields for the interpretation that was
+// requested are set.
+struct ParseResult {
+  std::unique_ptr<mg::data::NamView> nam;
+  std::unique_ptr<mg::data::MappedMzp> mzp;
+  std::shared_ptr<std::string> mzx_decoded;
+  std::vector<std::string_view> strings;
+  std::shared_ptr<mg::fs::MappedFile> mrg_file;
+  std::unique_ptr<mg::data::MappedMrg> mrg;
+  std::unique_ptr<mg::data::NamView> mrg_names;
+  std::unique_ptr<mg::data::MappedHfa> hfa;
+  std::shared_ptr<std::string> nxx_decoded;
 };
 
+struct ParseJob {
+  std::shared_ptr<mg::util::Progress> progress;
+  std::future<ParseResult> result;
+  // Whether the work checks for cancellation, rather than just running to
+  // completion
+  bool cancellable = false;
+};
+
+// Decoding and parsing runs here, so that large payloads never stall the
+// render thread
+mg::util::ThreadPool parse_pool;
+
 struct DataFile;
 std::vector<std::shared_ptr<DataFile>> data_file_contexts;
 
-struct DataFile {
+// Map the MRG that a path belongs to, given the .mrg, .hed or .nam path or
+// the shared basename. Only the HED is read up front; entry data is paged in
+// from the mapping as it is viewed.
+ParseResult parse_mrg(const std::string &path) {
+  ParseResult ret;
+  std::filesystem::path basename(path);
+  if (basename.extension() == ".mrg" || basename.extension() == ".hed" ||
+      basename.extension() == ".nam") {
+    basename.replace_extension("");
+  }
+
+  std::string hed;
+  if (!mg::fs::read_file((basename.string() + ".hed").c_str(), hed)) {
+    return ret;
+  }
+  ret.mrg_file = mg::fs::MappedFile::open((basename.string() + ".mrg").c_str());
+  if (ret.mrg_file == nullptr) {
+    return ret;
+  }
+  ret.mrg = mg::data::MappedMrg::parse(hed, ret.mrg_file);
+
+  // Names are optional
+  const std::string nam_path = basename.string() + ".nam";
+  if (ret.mrg != nullptr && std::filesystem::exists(nam_path)) {
+    std::shared_ptr<mg::fs::MappedFile> nam_file =
+        mg::fs::MappedFile::open(nam_path.c_str());
+    ret.mrg_names = nam_file ? mg::data::NamView::parse(nam_file) : nullptr;
+    if (ret.mrg_names != nullptr &&
+        ret.mrg_names->names().size() != ret.mrg->entries().size()) {
+      ret.mrg_names = nullptr;
+    }
+  }
+  return ret;
+}
+
+// Table flags for long lists. The table scrolls itself, so that only the rows
+// in view need to be submitted each frame.
+const ImGuiTableFlags LIST_TABLE_FLAGS =
+    ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg |
+    ImGuiTableFlags_BordersInnerH | ImGuiTableFlags_Resizable;
+
+// Draw an indexed list of strings. Every row is a single line, so the cost
+// per frame depends only on how many rows are visible. Text past the first
+// line break is shown in a tooltip.
+void render_string_list(const char *id,
+                        const std::vector<std::string_view> &rows) {
+  if (!ImGui::BeginTable(id, 2, LIST_TABLE_FLAGS)) {
+    return;
+  }
+  ImGui::TableSetupScrollFreeze(0, 1);
+  ImGui::TableSetupColumn("Index", ImGuiTableColumnFlags_WidthFixed);
+  ImGui::TableSetupColumn("Text", ImGuiTableColumnFlags_WidthStretch);
+  ImGui::TableHeadersRow();
+
+  ImGuiListClipper clipper;
+  clipper.Begin(rows.size(), ImGui::GetTextLineHeightWithSpacing());
+  while (clipper.Step()) {
+    for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+      const std::string_view row = rows[i];
+      const size_t line_end = std::min(row.find('\n'), row.size());
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("%d", i);
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(row.data(), row.data() + line_end);
+      if (line_end != row.size() && ImGui::IsItemHovered()) {
+        ImGui::SetTooltip("%.*s", (int)row.size(), row.data());
+      }
+    }
+  }
+  ImGui::EndTable();
+}
+
+struct DataFile : std::enable_shared_from_this<DataFile> {
   std::string file_name;
-  std::string raw_data;
+  // Location on disk, for files opened directly
+  std::string path;
+
+  // A view into the backing buffer, which is either the mapped root file or a
+  // decoded payload. Sub-archives share their parent's backing rather than
+  // copying out of it.
+  std::string_view data;
+  std::shared_ptr<const void> backing;
   DataType display_type = UNDEFINED;
 
-  DataFile *parent;
+  std::shared_ptr<DataFile> parent;
   unsigned parent_string_table_idx = -1;
 
-  bool parsed_data_valid;
-  void *parsed_data;
+  // Parse results, each computed in the background the first time the data
+  // is interpreted that way and kept for as long as this file is open
+  ParseState parse_state[DATA_TYPE_COUNT] = {};
+  ParseJob parse_jobs[DATA_TYPE_COUNT];
+  std::unique_ptr<mg::data::NamView> nam;
+  std::unique_ptr<mg::data::MappedMzp> mzp;
+  std::shared_ptr<std::string> mzx_decoded;
+  std::vector<std::string_view> strings;
+  std::shared_ptr<mg::fs::MappedFile> mrg_file;
+  std::unique_ptr<mg::data::MappedMrg> mrg;
+  std::unique_ptr<mg::data::NamView> mrg_names;
+  std::unique_ptr<mg::data::MappedHfa> hfa;
+  std::shared_ptr<std::string> nxx_decoded;
 
   MemoryEditor mem_edit;
 
+  static std::shared_ptr<DataFile> open(const char *path) {
+    // An MRG may be opened by its basename
+    const std::string mrg_path = std::string(path) + ".mrg";
+    const bool is_basename =
+        !std::filesystem::exists(path) && std::filesystem::exists(mrg_path);
+    std::shared_ptr<mg::fs::MappedFile> mapped =
+        mg::fs::MappedFile::open(is_basename ? mrg_path.c_str() : path);
+    if (mapped == nullptr) {
+      return nullptr;
+    }
+    auto ctx = std::make_shared<DataFile>();
+    ctx->file_name = path;
+    ctx->path = path;
+    ctx->data = mapped->string_view();
+    ctx->backing = mapped;
+    ctx->mem_edit.ReadOnly = true;
+    return ctx;
+  }
+
+  std::shared_ptr<DataFile> open_child(const std::string &name,
+                                       std::string_view child_data,
+                                       std::shared_ptr<const void> owner) {
+    auto ctx = std::make_shared<DataFile>();
+    ctx->file_name = name;
+    ctx->data = child_data;
+    ctx->backing = std::move(owner);
+    ctx->mem_edit.ReadOnly = true;
+    ctx->parent = shared_from_this();
+    return ctx;
+  }
+
+  // Run `work` on the parse pool. It must only touch what it captures.
+  void start_job(DataType type,
+                 std::function<ParseResult(mg::util::Progress &)> work) {
+    auto progress = std::make_shared<mg::util::Progress>();
+    parse_jobs[type].progress = progress;
+    parse_jobs[type].result = parse_pool.async(
+        [progress, work = std::move(work)]() { return work(*progress); });
+    parse_state[type] = PARSE_PENDING;
+  }
+
+  // As start_job(), for work that gives up once its progress is cancelled.
+  // Only these jobs offer a Cancel button.
+  void start_cancellable_job(
+      DataType type, std::function<ParseResult(mg::util::Progress &)> work) {
+    start_job(type, std::move(work));
+    parse_jobs[type].cancellable = true;
+  }
+
+  void cancel_job(DataType type) {
+    // A cancellable worker stops at its next progress check, others run to
+    // completion. Either way the result is dropped.
+    parse_jobs[type].progress->cancel();
+    parse_jobs[type] = ParseJob();
+    parse_state[type] = PARSE_CANCELLED;
+  }
+
+  void cancel_pending_jobs() {
+    for (unsigned type = 0; type < DATA_TYPE_COUNT; type++) {
+      if (parse_state[type] == PARSE_PENDING) {
+        cancel_job((DataType)type);
+      }
+    }
+  }
+
+  // Start parsing the data as `type` if that has not already been tried, and
+  // swap in the results of any finished job
+  ParseState parse(DataType type) {
+    if (parse_state[type] == PARSE_NONE) {
+      // The job holds its own reference to the backing data
+      const std::string_view view = data;
+      std::shared_ptr<const void> owner = backing;
+      switch (type) {
+      case DATA_NAM:
+        start_job(type, [view, owner](mg::util::Progress &) {
+          ParseResult ret;
+          ret.nam = mg::data::NamView::parse(view);
+          return ret;
+        });
+        break;
+      case DATA_MZP:
+        start_job(type, [view, owner](mg::util::Progress &) {
+          ParseResult ret;
+          ret.mzp = mg::data::MappedMzp::parse(view);
+          return ret;
+        });
+        break;
+      case DATA_MZX:
+        start_cancellable_job(
+            type, [view, owner](mg::util::Progress &progress) {
+              ParseResult ret;
+              auto decoded = std::make_shared<std::string>();
+              if (mg::data::mzx_decompress(view, *decoded, true, &progress)) {
+                ret.mzx_decoded = std::move(decoded);
+              }
+              return ret;
+            });
+        break;
+      case DATA_MRG:
+        // Needs the sibling files on disk
+        if (path.empty()) {
+          parse_state[type] = PARSE_DONE;
+          break;
+        }
+        start_job(type, [mrg_path = path](mg::util::Progress &) {
+          return parse_mrg(mrg_path);
+        });
+        break;
+      case DATA_HFA:
+        start_job(type, [view, owner](mg::util::Progress &) {
+          ParseResult ret;
+          ret.hfa = mg::data::MappedHfa::parse(view);
+          return ret;
+        });
+        break;
+      case DATA_NXX:
+        start_cancellable_job(
+            type, [view, owner](mg::util::Progress &progress) {
+              ParseResult ret;
+              auto decoded = std::make_shared<std::string>();
+              if (mg::data::nxx_decompress(view, *decoded, &progress)) {
+                ret.nxx_decoded = std::move(decoded);
+              }
+              return ret;
+            });
+        break;
+      default:
+        // Nothing to parse up front
+        parse_state[type] = PARSE_DONE;
+        break;
+      }
+    }
+
+    if (parse_state[type] == PARSE_PENDING &&
+        parse_jobs[type].result.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready) {
+      ParseResult result = parse_jobs[type].result.get();
+      parse_jobs[type] = ParseJob();
+      parse_state[type] = PARSE_DONE;
+      switch (type) {
+      case DATA_NAM:
+        nam = std::move(result.nam);
+        break;
+      case DATA_MZP:
+        mzp = std::move(result.mzp);
+        break;
+      case DATA_MZX:
+        mzx_decoded = std::move(result.mzx_decoded);
+        break;
+      case DATA_STRING_TABLE:
+        strings = std::move(result.strings);
+        break;
+      case DATA_MRG:
+        mrg_file = std::move(result.mrg_file);
+        mrg = std::move(result.mrg);
+        mrg_names = std::move(result.mrg_names);
+        break;
+      case DATA_HFA:
+        hfa = std::move(result.hfa);
+        break;
+      case DATA_NXX:
+        nxx_decoded = std::move(result.nxx_decoded);
+        break;
+      default:
+        break;
+      }
+    }
+
+    return parse_state[type];
+  }
+
+  // Whether a finished parse succeeded
+  bool parse_valid(DataType type) const {
+    switch (type) {
+    case DATA_NAM:
+      return nam != nullptr;
+    case DATA_MZP:
+      return mzp != nullptr;
+    case DATA_MZX:
+      return mzx_decoded != nullptr;
+    case DATA_MRG:
+      return mrg != nullptr;
+    case DATA_HFA:
+      return hfa != nullptr;
+    case DATA_NXX:
+      return nxx_decoded != nullptr;
+    case DATA_HEXDUMP:
+    case DATA_STRING_TABLE:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  void render_progress(DataType type) {
+    const float fraction = parse_jobs[type].progress->fraction();
+    if (fraction < 0) {
+      ImGui::Text("Working...");
+    } else {
+      ImGui::ProgressBar(fraction);
+    }
+    if (parse_jobs[type].cancellable && ImGui::Button("Cancel")) {
+      cancel_job(type);
+    }
+  }
+
   bool render() {
     // Data type selectable
     ImGui::Text("Interpret data as:");
-    if (ImGui::Selectable("Hexdump", display_type == DATA_HEXDUMP)) {
-      display_type = DATA_HEXDUMP;
-      mem_edit.ReadOnly = true;
-      parsed_data_valid = true;
-    }
-    if (ImGui::Selectable("NAM", display_type == DATA_NAM)) {
-      display_type = DATA_NAM;
-      parsed_data = new mg::data::Nam;
-      parsed_data_valid = mg::data::nam_read(
-          raw_data, *reinterpret_cast<mg::data::Nam *>(parsed_data));
-    }
-    if (ImGui::Selectable("MZP", display_type == DATA_MZP)) {
-      display_type = DATA_MZP;
-      parsed_data = new mg::data::Mzp;
-      parsed_data_valid = mg::data::mzp_read(
-          raw_data, *reinterpret_cast<mg::data::Mzp *>(parsed_data));
-    }
-    if (ImGui::Selectable("MZX", display_type == DATA_MZX)) {
-      display_type = DATA_MZX;
-      parsed_data = new std::string;
-      parsed_data_valid = mg::data::mzx_decompress(
-          raw_data, *reinterpret_cast<std::string *>(parsed_data));
-    }
-    if (ImGui::Selectable("String Table", display_type == DATA_STRING_TABLE)) {
-      display_type = DATA_STRING_TABLE;
-      parsed_data = new std::vector<std::string>;
-      parsed_data_valid = true;
+    const std::pair<const char *, DataType> types[] = {
+        {"Hexdump", DATA_HEXDUMP}, {"NAM", DATA_NAM},
+        {"MZP", DATA_MZP},         {"MZX", DATA_MZX},
+        {"String Table", DATA_STRING_TABLE},
+        {"MRG", DATA_MRG},         {"HFA", DATA_HFA},
+        {"NXX", DATA_NXX},
+    };
+    for (auto &[label, type] : types) {
+      if (ImGui::Selectable(label, display_type == type)) {
+        display_type = type;
+      }
     }
 
     // Delegate detail render
-    if (!parsed_data_valid) {
+    if (display_type == UNDEFINED) {
+      return false;
+    }
+    switch (parse(display_type)) {
+    case PARSE_PENDING:
+      if (display_type != DATA_STRING_TABLE) {
+        render_progress(display_type);
+        return false;
+      }
+      break;
+    case PARSE_CANCELLED:
+      ImGui::Text("Cancelled.");
+      ImGui::SameLine();
+      if (ImGui::Button("Retry")) {
+        parse_state[display_type] = PARSE_NONE;
+      }
+      return false;
+    default:
+      break;
+    }
+    if (!parse_valid(display_type)) {
       ImGui::Text("Cannot interpret data this way.");
       return false;
     }
@@ -89,6 +438,12 @@ struct DataFile {
       return render_hex();
     case DATA_STRING_TABLE:
       return render_string_table();
+    case DATA_MRG:
+      return render_mrg();
+    case DATA_HFA:
+      return render_hfa();
+    case DATA_NXX:
+      return render_nxx();
     default:
       return false;
     }
@@ -100,108 +455,305 @@ struct DataFile {
       return false;
     }
 
-    if (parent->display_type != DATA_MZP) {
+    if (parent->mzp == nullptr) {
       ImGui::Text("Parent is not of type MZP");
       return false;
     }
 
     // Generate string table options
-    mg::data::Mzp *parent_mzp =
-        reinterpret_cast<mg::data::Mzp *>(parent->parsed_data);
-    for (unsigned i = 0; i < parent_mzp->entry_headers.size(); i++) {
-      if (ImGui::Selectable(mg::string::format("Entry %u", i).c_str(),
-                            parent_string_table_idx == i)) {
+    const mg::data::MappedMzp &parent_mzp = *parent->mzp;
+    const std::string preview =
+        parent_string_table_idx < parent_mzp.entries().size()
+            ? mg::string::format("Entry %u", parent_string_table_idx)
+            : "None";
+    if (!ImGui::BeginCombo("Offset table", preview.c_str())) {
+      return render_string_table_rows();
+    }
+    ImGuiListClipper clipper;
+    clipper.Begin(parent_mzp.entries().size());
+    while (clipper.Step()) {
+      for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+        if (!ImGui::Selectable(mg::string::format("Entry %u", i).c_str(),
+                               parent_string_table_idx == (unsigned)i)) {
+          continue;
+        }
         parent_string_table_idx = i;
 
-        // Re-extract string table indices
-        // Note string tables are big endian
-        uint32_t *offsets =
-            reinterpret_cast<uint32_t *>(parent_mzp->entry_data[i].data());
-        const unsigned offset_count =
-            parent_mzp->entry_data[i].size() / sizeof(uint32_t);
-        auto *extracted_strings = new std::vector<std::string>;
-        for (unsigned i = 0; i < offset_count; i++) {
-          uint32_t start_offset = mg::be_to_host_u32(offsets[i]);
-          uint32_t end_offset = i < offset_count - 1
-                                    ? mg::be_to_host_u32(offsets[i + 1])
-                                    : raw_data.size();
-          if (start_offset >= raw_data.size() || end_offset > raw_data.size()) {
-            extracted_strings->emplace_back(mg::string::format(
-                "Invalid offset range %08x - %08x", start_offset, end_offset));
-            continue;
-          }
-          extracted_strings->emplace_back(&raw_data[start_offset],
-                                          end_offset - start_offset);
+        // Re-extract the strings. The selected entry is the offset table that
+        // indexes this data.
+        if (parse_state[DATA_STRING_TABLE] == PARSE_PENDING) {
+          cancel_job(DATA_STRING_TABLE);
         }
-        parsed_data = extracted_strings;
+        strings.clear();
+        const std::string_view offsets = parent_mzp.entry_data(i);
+        const std::string_view view = data;
+        std::shared_ptr<const void> owners[] = {parent->backing, backing};
+        start_job(DATA_STRING_TABLE,
+                  [offsets, view, owners](mg::util::Progress &) {
+                    ParseResult ret;
+                    mg::data::string_table_read(offsets, view, ret.strings);
+                    return ret;
+                  });
       }
     }
+    ImGui::EndCombo();
 
-    int i = 0;
-    for (auto &str :
-         *reinterpret_cast<std::vector<std::string> *>(parsed_data)) {
-      ImGui::Separator();
-      ImGui::Text("%d", i++);
-      ImGui::Text("%s", str.c_str());
-    }
+    return render_string_table_rows();
+  }
 
+  bool render_string_table_rows() {
+    if (parse_state[DATA_STRING_TABLE] == PARSE_PENDING) {
+      render_progress(DATA_STRING_TABLE);
+      return false;
+    }
+    render_string_list("strings", strings);
     return false;
   }
 
   bool render_hex() {
-    mem_edit.DrawContents(raw_data.data(), raw_data.size());
+    mem_edit.DrawContents(const_cast<char *>(data.data()), data.size());
     return false;
   }
 
   bool render_nam() {
-    mg::data::Nam *nam = reinterpret_cast<mg::data::Nam *>(parsed_data);
-    int i = 0;
-    for (auto &name : nam->names) {
-      ImGui::Separator();
-      ImGui::Text("%d", i++);
-      ImGui::Text("%s", name.c_str());
-    }
+    render_string_list("names", nam->names());
     return false;
   }
 
   bool render_mzp() {
-    mg::data::Mzp *mzp = reinterpret_cast<mg::data::Mzp *>(parsed_data);
-    ImGui::Text("MZP with %lu entries", mzp->entry_headers.size());
+    return render_entry_table(
+        "MZP", mzp->entries().size(), data,
+        [](unsigned i) { return mg::string::format("%u", i); },
+        [&](unsigned i) { return mzp->entry_data(i); }, backing);
+  }
+
+  bool render_mzx() {
+    return render_decoded(mg::string::format("%s (MZX)", file_name.c_str()),
+                          mzx_decoded);
+  }
+
+  bool render_nxx() {
+    mg::data::Nxx header;
+    if (mg::data::extract_nxx_header(data, header)) {
+      ImGui::Text("%.4s: %u bytes, %u compressed", header.magic, header.size,
+                  header.compressed_size);
+    }
+    return render_decoded(mg::string::format("%s (NXX)", file_name.c_str()),
+                          nxx_decoded);
+  }
 
+  bool render_decoded(const std::string &name,
+                      const std::shared_ptr<std::string> &decoded) {
     bool did_add_ctx = false;
-    for (unsigned i = 0; i < mzp->entry_headers.size(); i++) {
-      auto &entry = mzp->entry_headers[i];
-      ImGui::PushID(i);
-      ImGui::Text("Entry %4u of size %08x offset %08x", i,
-                  entry.entry_data_size(),
-                  mzp->archive_entry_start_offset(entry));
-      ImGui::SameLine();
-      if (ImGui::Button("Open Subarchive")) {
-        // Create a new datafile context
-        auto ctx = std::make_unique<DataFile>();
-        ctx->file_name =
-            mg::string::format("%s (MZP) @ %u", file_name.c_str(), i);
-        ctx->raw_data = mzp->entry_data[i];
-        ctx->parent = this;
-        data_file_contexts.emplace_back(std::move(ctx));
-        did_add_ctx = true;
+    if (ImGui::Button("Open Decompressed")) {
+      // The decoded buffer is shared with the new context
+      data_file_contexts.emplace_back(open_child(name, *decoded, decoded));
+      did_add_ctx = true;
+    }
+    mem_edit.DrawContents(decoded->data(), decoded->size());
+
+    return did_add_ctx;
+  }
+
+  // Shared layout for archive entry tables. Only the header has been parsed;
+  // an entry's data is only touched once it is opened.
+  bool render_entry_table(
+      const char *kind, unsigned count, const std::string_view &container,
+      const std::function<std::string(unsigned)> &entry_name,
+      const std::function<std::string_view(unsigned)> &entry_data,
+      const std::shared_ptr<const void> &owner) {
+    ImGui::Text("%s with %u entries", kind, count);
+
+    bool did_add_ctx = false;
+    if (!ImGui::BeginTable("entries", 4, LIST_TABLE_FLAGS)) {
+      return false;
+    }
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Name");
+    ImGui::TableSetupColumn("Size");
+    ImGui::TableSetupColumn("Offset");
+    ImGui::TableSetupColumn("");
+    ImGui::TableHeadersRow();
+
+    ImGuiListClipper clipper;
+    clipper.Begin(count);
+    while (clipper.Step()) {
+      for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+        const std::string name = entry_name(i);
+        const std::string_view entry = entry_data(i);
+        ImGui::PushID(i);
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(name.c_str());
+        ImGui::TableNextColumn();
+        ImGui::Text("%08lx", entry.size());
+        ImGui::TableNextColumn();
+        ImGui::Text("%08lx", entry.data() - container.data());
+        // Parsing checked every entry lies within the container
+        ImGui::TableNextColumn();
+        if (ImGui::SmallButton("Open Subarchive")) {
+          // The new context views the entry in place
+          data_file_contexts.emplace_back(open_child(
+              mg::string::format("%s (%s) @ %s", file_name.c_str(), kind,
+                                 name.c_str()),
+              entry, owner));
+          did_add_ctx = true;
+        }
+        ImGui::PopID();
       }
-      ImGui::PopID();
     }
+    ImGui::EndTable();
 
     return did_add_ctx;
   }
 
-  bool render_mzx() {
-    std::string *data = reinterpret_cast<std::string *>(parsed_data);
-    mem_edit.ReadOnly = true;
-    mem_edit.DrawContents(data->data(), data->size());
+  bool render_mrg() {
+    return render_entry_table(
+        "MRG", mrg->entries().size(), mrg_file->string_view(),
+        [&](unsigned i) {
+          if (mrg_names == nullptr) {
+            return mg::string::format("%u", i);
+          }
+          const std::string_view name = mrg_names->names()[i];
+          return mg::string::format("%u.%.*s", i, (int)name.size(),
+                                    name.data());
+        },
+        [&](unsigned i) { return mrg->entry_data(i); }, mrg_file);
+  }
 
-    return false;
+  bool render_hfa() {
+    return render_entry_table(
+        "HFA", hfa->entries().size(), data,
+        [&](unsigned i) {
+          const auto &entry = hfa->entries()[i];
+          return std::string(entry.filename,
+                             strnlen(entry.filename, sizeof(entry.filename)));
+        },
+        [&](unsigned i) { return hfa->entry_data(i); }, backing);
+  }
+};
+
+// A search across the whole of the root archive. Matches are appended from
+// walker threads as they are found.
+struct SearchJob {
+  explicit SearchJob(std::vector<mg::data::SearchPattern> patterns)
+      : searcher(std::move(patterns)) {}
+
+  const mg::data::MultiSearcher searcher;
+  mg::util::Progress progress;
+  std::future<bool> result;
+
+  std::mutex mutex;
+  std::vector<mg::data::SearchHit> hits;
+};
+
+struct SearchPanel {
+  std::string root_path;
+  char query[256] = {};
+  bool hex = false;
+  std::string error;
+  std::shared_ptr<SearchJob> job;
+
+  void start() {
+    error.clear();
+    std::vector<mg::data::SearchPattern> patterns;
+    if (strlen(query) == 0) {
+      error = "Nothing to search for";
+      return;
+    }
+    if (hex) {
+      std::string bytes;
+      if (!mg::string::hex_to_bytes(query, bytes)) {
+        error = "Invalid hex";
+        return;
+      }
+      patterns.push_back(mg::data::SearchPattern{query, bytes});
+    } else if (!mg::data::search_patterns_for_text(query, patterns)) {
+      error = "Nothing to search for";
+      return;
+    }
+
+    // Any previous search stops on its own, and keeps its own results
+    if (job != nullptr) {
+      job->progress.cancel();
+    }
+    job = std::make_shared<SearchJob>(std::move(patterns));
+    job->result = parse_pool.async([job = job, path = root_path]() {
+      mg::data::WalkOptions options;
+      options.progress = &job->progress;
+      return mg::data::search_archive(
+          path.c_str(), job->searcher,
+          [&](const mg::data::SearchHit &hit) {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->hits.push_back(hit);
+          },
+          options);
+    });
+  }
+
+  void render() {
+    ImGui::Begin("Search");
+    const bool submitted =
+        ImGui::InputText("##query", query, sizeof(query),
+                         ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    ImGui::Checkbox("Hex", &hex);
+    ImGui::SameLine();
+    if (ImGui::Button("Search") || submitted) {
+      start();
+    }
+    if (!error.empty()) {
+      ImGui::TextUnformatted(error.c_str());
+    }
+    if (job == nullptr) {
+      ImGui::End();
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(job->mutex);
+    const bool running = job->result.valid() &&
+                         job->result.wait_for(std::chrono::seconds(0)) !=
+                             std::future_status::ready;
+    ImGui::Text("%s: %lu matches, %lu payloads visited",
+                running ? "Searching" : "Done", job->hits.size(),
+                job->progress.done.load());
+    if (running) {
+      ImGui::SameLine();
+      if (ImGui::Button("Cancel")) {
+        job->progress.cancel();
+      }
+    }
+
+    if (ImGui::BeginTable("matches", 3, LIST_TABLE_FLAGS)) {
+      ImGui::TableSetupScrollFreeze(0, 1);
+      ImGui::TableSetupColumn("Payload", ImGuiTableColumnFlags_WidthStretch);
+      ImGui::TableSetupColumn("Offset");
+      ImGui::TableSetupColumn("Pattern");
+      ImGui::TableHeadersRow();
+
+      ImGuiListClipper clipper;
+      clipper.Begin(job->hits.size(), ImGui::GetTextLineHeightWithSpacing());
+      while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+          const auto &hit = job->hits[i];
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::TextUnformatted(hit.path.c_str());
+          ImGui::TableNextColumn();
+          ImGui::Text("%08lx", hit.offset);
+          ImGui::TableNextColumn();
+          ImGui::TextUnformatted(
+              job->searcher.patterns()[hit.pattern].label.c_str());
+        }
+      }
+      ImGui::EndTable();
+    }
+    ImGui::End();
   }
 };
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "data_explorer");
   if (argc != 2) {
     fprintf(stderr, "%s data_file\n", argv[0]);
     return -1;
@@ -237,13 +789,14 @@ int main(int argc, char **argv) {
   ImGui_ImplOpenGL2_Init();
 
   // Emplace the root data file
-  auto root_file = std::make_unique<DataFile>();
-  root_file->file_name = argv[1];
-  if (!mg::fs::read_file(argv[1], root_file->raw_data)) {
+  auto root_file = DataFile::open(argv[1]);
+  if (root_file == nullptr) {
     fprintf(stderr, "Failed to load root file\n");
     return -1;
   }
   data_file_contexts.emplace_back(std::move(root_file));
+  SearchPanel search_panel;
+  search_panel.root_path = argv[1];
 
   while (!glfwWindowShouldClose(window)) {
     glfwPollEvents();
@@ -260,6 +813,7 @@ int main(int argc, char **argv) {
         break;
       }
     }
+    search_panel.render();
 
     // Rendering
     ImGui::Render();
@@ -272,6 +826,15 @@ int main(int argc, char **argv) {
     glfwSwapBuffers(window);
   }
 
+  // The parse pool waits for its workers when it is destroyed, so stop any
+  // search or decode still running rather than finishing it
+  if (search_panel.job != nullptr) {
+    search_panel.job->progress.cancel();
+  }
+  for (auto &context : data_file_contexts) {
+    context->cancel_pending_jobs();
+  }
+
   ImGui_ImplOpenGL2_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
@@ -2,14 +2,17 @@
 #include <set>
 
 #include <mg/data/hfa.hpp>
+#include <mg/util/batch_io.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
 
 void usage(const char *program_name) {
   fprintf(stderr, "%s input_file [output_dir]\n", program_name);
 }
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "hfa_extract");
   // Parse args
   const char *input_basename = nullptr;
   const char *output_path = nullptr;
@@ -58,18 +61,15 @@ int main(int argc, char **argv) {
     return -1;
   }
 
-  // Utility method to write an index to an output file
-  auto write_entry = [&](unsigned index) -> int {
+  // Utility method to queue an index for writing to an output file
+  auto writer = mg::fs::BatchWriter::create();
+  std::vector<std::pair<std::string, size_t>> written;
+  auto write_entry = [&](unsigned index) {
     auto entry_data = hfa->entry_data(index);
     std::filesystem::path output_path = output_dir;
     output_path.append(hfa->entries().at(index).filename);
-    if (!mg::fs::write_file(output_path.c_str(), entry_data)) {
-      return -1;
-    }
-    fprintf(stderr, "Wrote %lu bytes to %s\n", entry_data.size(),
-            output_path.c_str());
-
-    return 0;
+    writer->write_file(output_path, entry_data);
+    written.emplace_back(output_path, entry_data.size());
   };
 
   // Iterate the mrg entries and emit
@@ -78,5 +78,13 @@ int main(int argc, char **argv) {
     write_entry(i);
   }
 
+  // Wait for the writes to land
+  if (!writer->flush()) {
+    return -1;
+  }
+  for (auto &file : written) {
+    fprintf(stderr, "Wrote %lu bytes to %s\n", file.second, file.first.c_str());
+  }
+
   return 0;
 }
@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <vector>
+
+#include <mg/data/mrg.hpp>
+#include <mg/data/mzp.hpp>
+#include <mg/data/mzx.hpp>
+#include <mg/data/nam.hpp>
+#include <mg/data/nxx.hpp>
+#include <mg/util/json.hpp>
+#include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
+
+// Every allocation made by the process is counted, so that each benchmark can
+// report how many it makes per iteration. Allocation tracking builds already
+// replace operator new to do this.
+#ifdef MG_TRACE_ALLOCATIONS
+namespace {
+mg::trace::AllocationCounts allocations() {
+  return mg::trace::process_allocations();
+}
+} // namespace
+#else
+namespace {
+std::atomic<uint64_t> allocation_count{0};
+std::atomic<uint64_t> allocation_bytes{0};
+mg::trace::AllocationCounts allocations() {
+  return mg::trace::AllocationCounts{allocation_count, allocation_bytes};
+}
+} // namespace
+
+void *operator new(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+  void *ret = malloc(size == 0 ? 1 : size);
+  if (ret == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ret;
+}
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+#endif
+
+namespace {
+
+// Deterministic data, so that results are comparable between runs
+class Rng {
+public:
+  explicit Rng(uint64_t seed) : _state(seed) {}
+  uint64_t next() {
+    _state ^= _state << 13;
+    _state ^= _state >> 7;
+    _state ^= _state << 17;
+    return _state;
+  }
+  unsigned below(unsigned bound) { return bound == 0 ? 0 : next() % bound; }
+
+private:
+  uint64_t _state;
+};
+
+// Script-like lines: commands, ASCII words and two byte Shift-JIS characters
+std::string generate_text(size_t size) {
+  static const char *const WORDS[] = {
+      "_STCH(8,img2511,413,225,1000,0,3102,,CC,,,)",
+      "_SEPL(1,0,MOON_SE02070,,`017:100)",
+      "_VPLY(v00123,0)",
+      "_PGST(1):",
+      "Arcueid",
+      "Shiki",
+      "the",
+      "moon",
+  };
+  Rng rng(1);
+  std::string ret;
+  ret.reserve(size + 64);
+  while (ret.size() < size) {
+    const unsigned words = 1 + rng.below(12);
+    for (unsigned i = 0; i < words; i++) {
+      if (rng.below(3) == 0) {
+        ret += WORDS[rng.below(sizeof(WORDS) / sizeof(WORDS[0]))];
+      } else {
+        // Kanji / kana range lead and trail bytes
+        ret += (char)(0x82 + rng.below(8));
+        ret += (char)(0x40 + rng.below(0xBC));
+      }
+    }
+    ret += "\r\n";
+  }
+  ret.resize(size);
+  return ret;
+}
+
+// RGBA rows of smooth gradients with a little noise
+std::string generate_image(size_t size) {
+  Rng rng(2);
+  std::string ret(size, '\0');
+  const size_t row_pixels = 512;
+  for (size_t i = 0; i + 4 <= size; i += 4) {
+    const size_t pixel = i / 4;
+    const size_t x = pixel % row_pixels;
+    const size_t y = pixel / row_pixels;
+    ret[i + 0] = (char)(x / 2 + rng.below(2));
+    ret[i + 1] = (char)(y / 2);
+    ret[i + 2] = (char)((x + y) / 4);
+    ret[i + 3] = (char)0xFF;
+  }
+  return ret;
+}
+
+std::string generate_random(size_t size) {
+  Rng rng(3);
+  std::string ret(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    ret[i] = (char)rng.next();
+  }
+  return ret;
+}
+
+struct Result {
+  std::string name;
+  std::string corpus;
+  // Bytes processed per iteration, which throughput is measured against
+  uint64_t bytes;
+  uint64_t iterations;
+  double seconds;
+  uint64_t allocations;
+  uint64_t allocated_bytes;
+};
+
+struct Options {
+  size_t corpus_size = 4 * 1024 * 1024;
+  unsigned entry_count = 256;
+  double min_time = 0.5;
+  const char *filter = nullptr;
+};
+
+class Runner {
+public:
+  explicit Runner(const Options &options) : _options(options) {}
+
+  // Time `iteration` until min_time has passed. The first run is a warm up,
+  // and is excluded from both timing and allocation counts.
+  void run(const std::string &name, const std::string &corpus, uint64_t bytes,
+           const std::function<bool()> &iteration) {
+    const std::string full_name = name + "/" + corpus;
+    if (_options.filter != nullptr &&
+        full_name.find(_options.filter) == std::string::npos) {
+      return;
+    }
+    if (!iteration()) {
+      fprintf(stderr, "%s failed\n", full_name.c_str());
+      _failed = true;
+      return;
+    }
+
+    const mg::trace::AllocationCounts allocations_start = allocations();
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t iterations = 0;
+    double elapsed = 0;
+    do {
+      iteration();
+      iterations++;
+      elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    } while (elapsed < _options.min_time);
+
+    const mg::trace::AllocationCounts allocations_end = allocations();
+    _results.push_back(
+        Result{name, corpus, bytes, iterations, elapsed,
+               allocations_end.count - allocations_start.count,
+               allocations_end.bytes - allocations_start.bytes});
+    fprintf(stderr, "%-20s %-8s %10.1f MB/s\n", name.c_str(), corpus.c_str(),
+            (double)bytes * iterations / elapsed / 1e6);
+  }
+
+  const std::vector<Result> &results() const { return _results; }
+  bool failed() const { return _failed; }
+
+private:
+  const Options &_options;
+  std::vector<Result> _results;
+  bool _failed = false;
+};
+
+void bench_codecs(Runner &runner, const std::string &corpus,
+                  const std::string &data) {
+  std::string mzx;
+  runner.run("mzx_compress", corpus, data.size(),
+             [&]() { return mg::data::mzx_compress(data, mzx); });
+  std::string mzx_decoded;
+  runner.run("mzx_decompress", corpus, data.size(), [&]() {
+    return mg::data::mzx_decompress(mzx, mzx_decoded);
+  });
+
+  std::string nxgx;
+  runner.run("nxgx_compress", corpus, data.size(),
+             [&]() { return mg::data::nxgx_compress(data, nxgx); });
+  std::string nxgx_decoded;
+  runner.run("nxx_decompress", corpus, data.size(), [&]() {
+    return mg::data::nxx_decompress(nxgx, nxgx_decoded);
+  });
+}
+
+void bench_archives(Runner &runner, const std::string &corpus,
+                    const std::string &data, unsigned entry_count) {
+  // Entries of varying size, covering all of the data
+  std::vector<std::string_view> entries;
+  Rng rng(4);
+  const size_t mean_size = data.size() / entry_count;
+  size_t offset = 0;
+  for (unsigned i = 0; i < entry_count && offset < data.size(); i++) {
+    const size_t size = i + 1 == entry_count
+                            ? data.size() - offset
+                            : std::min(data.size() - offset,
+                                       mean_size / 2 + rng.below(mean_size));
+    entries.push_back(std::string_view(data).substr(offset, size));
+    offset += size;
+  }
+
+  // MRG
+  mg::data::Mrg mrg;
+  for (auto &entry : entries) {
+    mrg.entries.emplace_back(std::string(entry));
+  }
+  std::string hed;
+  std::string mrg_data;
+  runner.run("mrg_write", corpus, data.size(),
+             [&]() { return mg::data::mrg_write(mrg, hed, mrg_data); });
+  runner.run("mrg_read", corpus, data.size(), [&]() {
+    mg::data::Mrg out;
+    return mg::data::mrg_read(hed, mrg_data, out);
+  });
+  runner.run("mapped_mrg_parse", corpus, hed.size(), [&]() {
+    return mg::data::MappedMrg::parse(hed, mrg_data) != nullptr;
+  });
+
+  // MZP
+  mg::data::Mzp mzp;
+  for (auto &entry : entries) {
+    mzp.add_entry(std::string(entry));
+  }
+  std::string mzp_data;
+  runner.run("mzp_write", corpus, data.size(), [&]() {
+    mzp_data.clear();
+    mg::data::mzp_write(mzp, mzp_data);
+    return true;
+  });
+  runner.run("mzp_read", corpus, data.size(), [&]() {
+    mg::data::Mzp out;
+    return mg::data::mzp_read(mzp_data, out);
+  });
+}
+
+void bench_nam(Runner &runner, unsigned entry_count) {
+  mg::data::Nam nam;
+  for (unsigned i = 0; i < entry_count; i++) {
+    nam.names.push_back(mg::string::format("ENTRY_%05u", i));
+  }
+  std::string nam_data;
+  if (!mg::data::nam_write(nam, nam_data)) {
+    return;
+  }
+  runner.run("nam_read", "names", nam_data.size(), [&]() {
+    mg::data::Nam out;
+    return mg::data::nam_read(nam_data, out);
+  });
+}
+
+void print_csv(const std::vector<Result> &results) {
+  printf("benchmark,corpus,bytes,iterations,seconds,mb_per_s,"
+         "allocations_per_iteration,allocated_bytes_per_iteration\n");
+  for (auto &result : results) {
+    printf("%s,%s,%lu,%lu,%.6f,%.3f,%.1f,%.1f\n", result.name.c_str(),
+           result.corpus.c_str(), result.bytes, result.iterations,
+           result.seconds,
+           (double)result.bytes * result.iterations / result.seconds / 1e6,
+           (double)result.allocations / result.iterations,
+           (double)result.allocated_bytes / result.iterations);
+  }
+}
+
+void print_json(const std::vector<Result> &results) {
+  std::string out = "[";
+  for (auto &result : results) {
+    out += out.size() == 1 ? "\n" : ",\n";
+    out += "  {\"benchmark\": ";
+    mg::json::append_string(result.name, out);
+    out += ", \"corpus\": ";
+    mg::json::append_string(result.corpus, out);
+    out += mg::string::format(
+        ", \"bytes\": %lu, \"iterations\": %lu, \"seconds\": %.6f, "
+        "\"mb_per_s\": %.3f, \"allocations_per_iteration\": %.1f, "
+        "\"allocated_bytes_per_iteration\": %.1f}",
+        result.bytes, result.iterations, result.seconds,
+        (double)result.bytes * result.iterations / result.seconds / 1e6,
+        (double)result.allocations / result.iterations,
+        (double)result.allocated_bytes / result.iterations);
+  }
+  out += "\n]\n";
+  fwrite(out.data(), 1, out.size(), stdout);
+}
+
+void usage(const char *program_name) {
+  fprintf(stderr,
+          "%s [--size bytes] [--entries count] [--min-time seconds] "
+          "[--filter substring] [--json]\n",
+          program_name);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  // Parse args
+  Options options;
+  bool json = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp("--json", argv[i])) {
+      json = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return -1;
+    }
+    const char *value = argv[i + 1];
+    char *endptr;
+    if (!strcmp("--size", argv[i])) {
+      options.corpus_size = strtoul(value, &endptr, 0);
+    } else if (!strcmp("--entries", argv[i])) {
+      options.entry_count = strtoul(value, &endptr, 0);
+    } else if (!strcmp("--min-time", argv[i])) {
+      options.min_time = strtod(value, &endptr);
+    } else if (!strcmp("--filter", argv[i])) {
+      options.filter = value;
+      endptr = const_cast<char *>(value) + strlen(value);
+    } else {
+      usage(argv[0]);
+      return -1;
+    }
+    if (endptr == value || *endptr != '\0') {
+      fprintf(stderr, "Failed to parse '%s'\n", value);
+      return -1;
+    }
+    i++;
+  }
+  if (options.corpus_size == 0 || options.entry_count == 0 ||
+      options.entry_count > 0xFFFF) {
+    fprintf(stderr, "Size must be nonzero, and entries between 1 and %u\n",
+            0xFFFF);
+    return -1;
+  }
+  if (options.corpus_size < options.entry_count) {
+    fprintf(stderr, "Size must be at least one byte per entry\n");
+    return -1;
+  }
+
+  Runner runner(options);
+  const std::pair<const char *, std::string> corpora[] = {
+      {"text", generate_text(options.corpus_size)},
+      {"image", generate_image(options.corpus_size)},
+      {"random", generate_random(options.corpus_size)},
+  };
+  for (auto &[corpus, data] : corpora) {
+    bench_codecs(runner, corpus, data);
+    bench_archives(runner, corpus, data, options.entry_count);
+  }
+  bench_nam(runner, options.entry_count);
+
+  if (json) {
+    print_json(runner.results());
+  } else {
+    print_csv(runner.results());
+  }
+
+  return runner.failed() ? -1 : 0;
+}
@@ -0,0 +1,109 @@
+#include <string.h>
+
+#include <mutex>
+
+#include <mg/data/search.hpp>
+#include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
+
+void usage(const char *program_name) {
+  fprintf(stderr,
+          "%s [-j threads] [--max-depth depth] [--no-decompress] [--hex] "
+          "[-e pattern]... [pattern] input\n",
+          program_name);
+}
+
+int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mg_grep");
+  // Parse args
+  mg::data::WalkOptions options;
+  bool hex = false;
+  std::vector<const char *> pattern_args;
+  std::vector<const char *> positional;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp("-j", argv[i]) || !strcmp("--max-depth", argv[i])) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing argument for %s\n", argv[i]);
+        return -1;
+      }
+      char *endptr;
+      const long value = strtol(argv[i + 1], &endptr, 0);
+      if (endptr == argv[i + 1] || value < 0) {
+        fprintf(stderr, "Failed to parse '%s'\n", argv[i + 1]);
+        return -1;
+      }
+      if (!strcmp("-j", argv[i])) {
+        options.thread_count = value;
+      } else {
+        options.max_depth = value;
+      }
+      i++;
+      continue;
+    }
+    if (!strcmp("-e", argv[i])) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing argument for %s\n", argv[i]);
+        return -1;
+      }
+      pattern_args.push_back(argv[++i]);
+      continue;
+    }
+    if (!strcmp("--no-decompress", argv[i])) {
+      options.decompress = false;
+      continue;
+    }
+    if (!strcmp("--hex", argv[i])) {
+      hex = true;
+      continue;
+    }
+    positional.push_back(argv[i]);
+  }
+
+  // Without -e, the first positional argument is the pattern
+  if (pattern_args.empty() && !positional.empty()) {
+    pattern_args.push_back(positional.front());
+    positional.erase(positional.begin());
+  }
+  if (pattern_args.empty() || positional.size() != 1) {
+    usage(argv[0]);
+    return -1;
+  }
+  const char *input = positional.front();
+
+  // Hex patterns are searched as given, text as both UTF-8 and Shift-JIS
+  std::vector<mg::data::SearchPattern> patterns;
+  for (const char *arg : pattern_args) {
+    if (strlen(arg) == 0) {
+      fprintf(stderr, "Patterns must not be empty\n");
+      return -1;
+    }
+    if (hex) {
+      std::string bytes;
+      if (!mg::string::hex_to_bytes(arg, bytes)) {
+        fprintf(stderr, "Failed to parse hex pattern '%s'\n", arg);
+        return -1;
+      }
+      patterns.push_back(mg::data::SearchPattern{arg, bytes});
+    } else if (!mg::data::search_patterns_for_text(arg, patterns)) {
+      return -1;
+    }
+  }
+  mg::data::MultiSearcher searcher(std::move(patterns));
+
+  // Print matches as they arrive
+  std::mutex mutex;
+  mg::data::SearchStats stats;
+  const bool ok = mg::data::search_archive(
+      input, searcher,
+      [&](const mg::data::SearchHit &hit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        printf("%s,%lu,%s\n", hit.path.c_str(), hit.offset,
+               searcher.patterns()[hit.pattern].label.c_str());
+      },
+      options, &stats);
+
+  fprintf(stderr, "%lu matches in %lu payloads (%lu bytes)\n", stats.hits,
+          stats.payloads, stats.bytes);
+
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,116 @@
+#include <string.h>
+
+#include <mg/data/script.hpp>
+#include <mg/util/trace.hpp>
+
+void usage(const char *program_name) {
+  fprintf(stderr,
+          "%s [-j threads] [--asset name] [--scene path] [--pages] input\n",
+          program_name);
+}
+
+int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mg_script_index");
+  // Parse args
+  mg::data::WalkOptions options;
+  const char *asset = nullptr;
+  const char *scene = nullptr;
+  bool print_pages = false;
+  const char *input = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp("-j", argv[i]) || !strcmp("--asset", argv[i]) ||
+        !strcmp("--scene", argv[i])) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing argument for %s\n", argv[i]);
+        return -1;
+      }
+      if (!strcmp("--asset", argv[i])) {
+        asset = argv[++i];
+        continue;
+      }
+      if (!strcmp("--scene", argv[i])) {
+        scene = argv[++i];
+        continue;
+      }
+      char *endptr;
+      const long value = strtol(argv[i + 1], &endptr, 0);
+      if (endptr == argv[i + 1] || value < 0) {
+        fprintf(stderr, "Failed to parse '%s'\n", argv[i + 1]);
+        return -1;
+      }
+      options.thread_count = value;
+      i++;
+      continue;
+    }
+    if (!strcmp("--pages", argv[i])) {
+      print_pages = true;
+      continue;
+    }
+    if (input == nullptr) {
+      input = argv[i];
+      continue;
+    }
+    usage(argv[0]);
+    return -1;
+  }
+
+  if (input == nullptr) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  mg::data::ScriptIndex index;
+  const bool ok = mg::data::script_index_build(input, index, options);
+
+  auto print_asset = [](const mg::data::AssetRef &ref,
+                        const mg::data::SceneInfo &info) {
+    printf("%s,%s,%s,%u\n", mg::data::asset_kind_name(ref.kind),
+           ref.name.c_str(), info.path.c_str(), ref.offset);
+  };
+  auto print_pages_of = [&](const mg::data::SceneInfo &info) {
+    if (!print_pages) {
+      return;
+    }
+    for (auto &page : info.pages) {
+      printf("page,%d,%s,%u\n", page.page, info.path.c_str(), page.offset);
+    }
+  };
+
+  if (asset != nullptr) {
+    // Every use of one asset
+    for (auto &use : index.find_asset(asset)) {
+      print_asset(index.asset(use), index.scenes()[use.scene]);
+    }
+  } else if (scene != nullptr) {
+    // Everything in one script
+    const mg::data::SceneInfo *info = index.find_scene(scene);
+    if (info == nullptr) {
+      fprintf(stderr, "No script at '%s'\n", scene);
+      return -1;
+    }
+    for (auto &ref : info->assets) {
+      print_asset(ref, *info);
+    }
+    print_pages_of(*info);
+  } else {
+    // The whole index, grouped by asset
+    for (auto &use : index.asset_uses()) {
+      print_asset(index.asset(use), index.scenes()[use.scene]);
+    }
+    for (auto &info : index.scenes()) {
+      print_pages_of(info);
+    }
+  }
+
+  // Summary
+  size_t asset_count = 0;
+  size_t page_count = 0;
+  for (auto &info : index.scenes()) {
+    asset_count += info.assets.size();
+    page_count += info.pages.size();
+  }
+  fprintf(stderr, "Indexed %lu scripts, %lu asset uses, %lu pages\n",
+          index.scenes().size(), asset_count, page_count);
+
+  return ok ? 0 : -1;
+}
@@ -0,0 +1,94 @@
+#include <string.h>
+
+#include <map>
+#include <mutex>
+
+#include <mg/data/walk.hpp>
+#include <mg/util/crypto.hpp>
+#include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
+
+void usage(const char *program_name) {
+  fprintf(stderr,
+          "%s [-j threads] [--max-depth depth] [--no-decompress] [--sha256] "
+          "input\n",
+          program_name);
+}
+
+int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mg_walk");
+  // Parse args
+  mg::data::WalkOptions options;
+  bool print_sha256 = false;
+  const char *input = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp("-j", argv[i]) || !strcmp("--max-depth", argv[i])) {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Missing argument for %s\n", argv[i]);
+        return -1;
+      }
+      char *endptr;
+      const long value = strtol(argv[i + 1], &endptr, 0);
+      if (endptr == argv[i + 1] || value < 0) {
+        fprintf(stderr, "Failed to parse '%s'\n", argv[i + 1]);
+        return -1;
+      }
+      if (!strcmp("-j", argv[i])) {
+        options.thread_count = value;
+      } else {
+        options.max_depth = value;
+      }
+      i++;
+      continue;
+    }
+    if (!strcmp("--no-decompress", argv[i])) {
+      options.decompress = false;
+      continue;
+    }
+    if (!strcmp("--sha256", argv[i])) {
+      print_sha256 = true;
+      continue;
+    }
+    if (input == nullptr) {
+      input = argv[i];
+      continue;
+    }
+    usage(argv[0]);
+    return -1;
+  }
+
+  if (input == nullptr) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Per-format totals
+  std::mutex mutex;
+  std::map<mg::data::Format, std::pair<uint64_t, uint64_t>> stats;
+
+  const bool ok = mg::data::walk(
+      input,
+      [&](const std::string &path, mg::data::Format format,
+          const std::string_view &data) {
+        // Do the hashing outside of the lock
+        const std::string digest =
+            print_sha256 ? mg::string::bytes_to_hex(mg::util::sha256(data))
+                         : "";
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto &[count, bytes] = stats[format];
+        count++;
+        bytes += data.size();
+        printf("%s,%s,%lu%s%s\n", path.c_str(), mg::data::format_name(format),
+               data.size(), print_sha256 ? "," : "", digest.c_str());
+      },
+      options);
+
+  // Summary
+  for (auto &[format, totals] : stats) {
+    fprintf(stderr, "%-6s %10lu entries %16lu bytes\n",
+            mg::data::format_name(format), totals.first, totals.second);
+  }
+
+  return ok ? 0 : -1;
+}
@@ -3,8 +3,10 @@
 
 #include <mg/data/mrg.hpp>
 #include <mg/data/nam.hpp>
+#include <mg/util/batch_io.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
 
 void usage(const char *program_name) {
   fprintf(stderr, "%s [-i index...] input_basename [output_dir]\n",
@@ -12,6 +14,7 @@ void usage(const char *program_name) {
 }
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mrg_extract");
   // Parse args
   bool targeted_extract = false;
   std::set<long> extract_indices;
@@ -83,12 +86,13 @@ int main(int argc, char **argv) {
     return -1;
   }
 
-  // Try and read the NAM table as well. If we can't that's OK
+  // Try and map the NAM table as well. If we can't that's OK
   const std::string nam_filename = mg::string::format("%s.nam", input_basename);
-  std::string nam_raw;
-  mg::data::Nam nam;
-  const bool has_nam = mg::fs::read_file(nam_filename.c_str(), nam_raw) &&
-                       nam_read(nam_raw, nam);
+  std::shared_ptr<mg::fs::MappedFile> nam_data =
+      mg::fs::MappedFile::open(nam_filename.c_str());
+  std::unique_ptr<mg::data::NamView> nam =
+      nam_data ? mg::data::NamView::parse(nam_data) : nullptr;
+  const bool has_nam = nam != nullptr;
 
   // Parse the MRG data
   auto mrg = mg::data::MappedMrg::parse(hed_raw, mrg_data);
@@ -98,10 +102,10 @@ int main(int argc, char **argv) {
 
   // If we have a NAM and MRG, assert that the filename count matches the entry
   // count
-  if (has_nam && mrg->entries().size() != nam.names.size()) {
+  if (has_nam && mrg->entries().size() != nam->names().size()) {
     fprintf(stderr,
             "MRG entry count (%lu) does not match NAM entry count (%lu)\n",
-            mrg->entries().size(), nam.names.size());
+            mrg->entries().size(), nam->names().size());
     return -1;
   }
 
@@ -113,30 +117,28 @@ int main(int argc, char **argv) {
     return -1;
   }
 
-  // Utility method to write an index to an output file
+  // Utility method to queue an index for writing to an output file
   const std::string output_basename =
       std::filesystem::path(input_basename).stem();
-  auto write_entry = [&](unsigned index) -> int {
+  auto writer = mg::fs::BatchWriter::create();
+  std::vector<std::pair<std::string, size_t>> written;
+  auto write_entry = [&](unsigned index) {
     std::string output_filename =
         mg::string::format("%s.%08lu.dat", output_basename.c_str(), index);
 
     // If we have a name table, use that name as well
     if (has_nam) {
+      const std::string_view name = nam->names()[index];
       output_filename =
-          mg::string::format("%s.%08lu.%s.dat", output_basename.c_str(), index,
-                             nam.names[index].c_str());
+          mg::string::format("%s.%08lu.%.*s.dat", output_basename.c_str(),
+                             index, (int)name.size(), name.data());
     }
 
     auto entry_data = mrg->entry_data(index);
     std::filesystem::path output_path = output_dir;
     output_path.append(output_filename);
-    if (!mg::fs::write_file(output_path.c_str(), entry_data)) {
-      return -1;
-    }
-    fprintf(stderr, "Wrote %lu bytes to %s\n", entry_data.size(),
-            output_path.c_str());
-
-    return 0;
+    writer->write_file(output_path, entry_data);
+    written.emplace_back(output_path, entry_data.size());
   };
 
   // Iterate the mrg entries and emit
@@ -151,5 +153,13 @@ int main(int argc, char **argv) {
     }
   }
 
+  // Wait for the writes to land
+  if (!writer->flush()) {
+    return -1;
+  }
+  for (auto &file : written) {
+    fprintf(stderr, "Wrote %lu bytes to %s\n", file.second, file.first.c_str());
+  }
+
   return 0;
 }
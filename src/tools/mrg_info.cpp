@@ -2,6 +2,7 @@
 #include <mg/data/nam.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
 
 #include <filesystem>
 
@@ -10,6 +11,7 @@ void usage(const char *program_name) {
 }
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mrg_info");
   // Parse args
   bool csv = false;
   const char *input_basename = nullptr;
@@ -49,12 +51,13 @@ int main(int argc, char **argv) {
     return -1;
   }
 
-  // Try and read the NAM table as well. If we can't that's OK
+  // Try and map the NAM table as well. If we can't that's OK
   const std::string nam_filename = mg::string::format("%s.nam", input_basename);
-  std::string nam_raw;
-  mg::data::Nam nam;
-  const bool has_nam = mg::fs::read_file(nam_filename.c_str(), nam_raw) &&
-                       nam_read(nam_raw, nam);
+  std::shared_ptr<mg::fs::MappedFile> nam_data =
+      mg::fs::MappedFile::open(nam_filename.c_str());
+  std::unique_ptr<mg::data::NamView> nam =
+      nam_data ? mg::data::NamView::parse(nam_data) : nullptr;
+  const bool has_nam = nam != nullptr;
 
   // Parse the MRG data
   auto mrg = mg::data::MappedMrg::parse(hed_raw, mrg_data);
@@ -64,10 +67,10 @@ int main(int argc, char **argv) {
 
   // If we have a NAM and MRG, assert that the filename count matches the entry
   // count
-  if (has_nam && mrg->entries().size() != nam.names.size()) {
+  if (has_nam && mrg->entries().size() != nam->names().size()) {
     fprintf(stderr,
             "MRG entry count (%lu) does not match NAM entry count (%lu)\n",
-            mrg->entries().size(), nam.names.size());
+            mrg->entries().size(), nam->names().size());
     return -1;
   }
 
@@ -75,7 +78,9 @@ int main(int argc, char **argv) {
   for (unsigned i = 0; i < mrg->entries().size(); i++) {
     const std::string name_info =
         !has_nam ? ""
-                 : mg::string::format(", Name: '%s'", nam.names[i].c_str());
+                 : mg::string::format(", Name: '%.*s'",
+                                      (int)nam->names()[i].size(),
+                                      nam->names()[i].data());
     const bool is_compressed = mrg->entries()[i].size_sectors !=
                                mrg->entries()[i].size_uncompressed_sectors;
     const std::string compress_info =
@@ -84,10 +89,11 @@ int main(int argc, char **argv) {
             : mg::string::format(", Uncompressed size 0x%08x sectors",
                                  mrg->entries()[i].size_uncompressed_sectors);
     if (csv) {
-      printf("%u,0x%08x,0x%08x,0x%08x,%s\n", i, mrg->entries()[i].offset,
+      const std::string_view name = has_nam ? nam->names()[i] : "";
+      printf("%u,0x%08x,0x%08x,0x%08x,%.*s\n", i, mrg->entries()[i].offset,
              mrg->entries()[i].size_sectors,
-             mrg->entries()[i].size_uncompressed_sectors,
-             has_nam ? nam.names[i].c_str() : "");
+             mrg->entries()[i].size_uncompressed_sectors, (int)name.size(),
+             name.data());
     } else {
       printf("Entry %8u: Offset 0x%08x, Size 0x%08x sectors%s%s\n", i,
              mrg->entries()[i].offset, mrg->entries()[i].size_sectors,
@@ -95,5 +101,11 @@ int main(int argc, char **argv) {
     }
   }
 
+  // Overlaps are found when the archive is parsed
+  for (auto &overlap : mrg->overlaps()) {
+    fprintf(stderr, "Entry %u begins inside of entry %u\n", overlap.second,
+            overlap.first);
+  }
+
   return 0;
 }
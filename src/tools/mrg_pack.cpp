@@ -3,12 +3,14 @@
 #include <mg/data/nxx.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
 
 #include <filesystem>
 #include <sstream>
 #include <string>
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mrg_pack");
   if (argc < 3) {
     fprintf(stderr, "%s output_basename [--names name_list] inputs...\n",
             argv[0]);
@@ -78,20 +80,25 @@ int main(int argc, char **argv) {
     }
   }
 
-  // Serialize mrg/hed
-  std::string mrg_out, hed_out;
-  if (!mg::data::mrg_write(mrg, hed_out, mrg_out)) {
+  // Serialize mrg data directly into the output file, and the hed alongside
+  std::string hed_filename = mg::string::format("%s.hed", output_basename);
+  std::string mrg_filename = mg::string::format("%s.mrg", output_basename);
+  auto mrg_out = mg::fs::MappedFile::create(mrg_filename.c_str(),
+                                            mg::data::mrg_data_size(mrg));
+  if (mrg_out == nullptr) {
+    return -1;
+  }
+  std::string hed_out;
+  if (!mg::data::mrg_write(mrg, hed_out, mrg_out->mutable_data())) {
     fprintf(stderr, "Failed to pack MRG\n");
     return -1;
   }
 
   // Write outputs
-  std::string hed_filename = mg::string::format("%s.hed", output_basename);
-  std::string mrg_filename = mg::string::format("%s.mrg", output_basename);
   if (!mg::fs::write_file(hed_filename.c_str(), hed_out)) {
     return -1;
   }
-  if (!mg::fs::write_file(mrg_filename.c_str(), mrg_out)) {
+  if (!mrg_out->finalize()) {
     return -1;
   }
 
@@ -7,6 +7,7 @@
 #include <mg/data/nxx.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
 
 void usage(const char *program_name) {
   fprintf(
@@ -16,6 +17,7 @@ void usage(const char *program_name) {
 }
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mrg_replace");
   // Parse args
   std::map<long, const char *> replace_indices;
   const char *input_basename = nullptr;
@@ -112,27 +114,31 @@ int main(int argc, char **argv) {
   const std::string output_mrg_filename =
       mg::string::format("%s.mrg", output_basename);
 
-  // Open hed output
-  const int hed_fd =
-      open(output_hed_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
-  if (hed_fd == -1) {
-    fprintf(stderr, "Failed to open '%s' - %s\n", output_hed_filename.c_str(),
-            strerror(errno));
+  // Work out the final output sizes up front, so that the outputs can be
+  // preallocated
+  uint64_t mrg_output_size = 0;
+  for (unsigned i = 0; i < mrg->entries().size(); i++) {
+    auto replacement = replacement_files.find(i);
+    mrg_output_size +=
+        replacement != replacement_files.end()
+            ? mg::data::Mrg::size_in_sectors(replacement->second->size()) *
+                  mg::data::Mrg::SECTOR_SIZE
+            : mrg->entry_data(i).size();
+  }
+  const uint64_t hed_output_size =
+      (mrg->entries().size() + 2) * sizeof(mg::data::Mrg::PackedEntryHeader);
+
+  // Open outputs
+  auto hed_out =
+      mg::fs::FileWriter::open(output_hed_filename.c_str(), hed_output_size);
+  if (hed_out == nullptr) {
     return -1;
   }
-  std::shared_ptr<void> _defer_close_hed_fd(nullptr,
-                                            [=](...) { close(hed_fd); });
-
-  // Open mrg output
-  const int mrg_fd =
-      open(output_mrg_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
-  if (mrg_fd == -1) {
-    fprintf(stderr, "Failed to open '%s' - %s\n", output_mrg_filename.c_str(),
-            strerror(errno));
+  auto mrg_out =
+      mg::fs::FileWriter::open(output_mrg_filename.c_str(), mrg_output_size);
+  if (mrg_out == nullptr) {
     return -1;
   }
-  std::shared_ptr<void> _defer_close_mrg_fd(nullptr,
-                                            [=](...) { close(mrg_fd); });
 
   // Padding buffer for rounding to the nearest segment
   char padding[mg::data::Mrg::SECTOR_SIZE];
@@ -177,32 +183,36 @@ int main(int argc, char **argv) {
     if (replace_index) {
       // Write the new data
       const auto &replacement_data = replacement_files.at(i);
-      ASSERT(write(mrg_fd, replacement_data->data(),
-                   replacement_data->size()) == replacement_data->size());
+      ASSERT(mrg_out->write(replacement_data->string_view()));
       mrg_write_offset += replacement_data->size();
 
       // Pad to the nearest sector
       const ssize_t bytes_to_pad =
           (header.size_sectors * mg::data::Mrg::SECTOR_SIZE) -
           replacement_data->size();
-      ASSERT(write(mrg_fd, padding, bytes_to_pad) == bytes_to_pad);
+      ASSERT(mrg_out->write(std::string_view(padding, bytes_to_pad)));
       mrg_write_offset += bytes_to_pad;
     } else {
       const auto old_data = mrg->entry_data(i);
-      ASSERT(write(mrg_fd, old_data.data(), old_data.size()) ==
-             (ssize_t)old_data.size());
+      ASSERT(mrg_out->write(old_data));
       mrg_write_offset += old_data.size();
     }
 
     // Write the hew HED entry
     header.to_file_order();
-    ASSERT(write(hed_fd, &header, sizeof(header)) == sizeof(header));
+    ASSERT(hed_out->write(std::string_view(
+        reinterpret_cast<const char *>(&header), sizeof(header))));
   }
 
   // Write two all-F HED entries to indicate EOF
   char eof[sizeof(mg::data::Mrg::PackedEntryHeader) * 2];
   memset(eof, 0xFF, sizeof(eof));
-  ASSERT(write(hed_fd, eof, sizeof(eof)) == sizeof(eof));
+  ASSERT(hed_out->write(std::string_view(eof, sizeof(eof))));
+
+  // Move both outputs into place
+  if (!mrg_out->commit() || !hed_out->commit()) {
+    return -1;
+  }
 
   return 0;
 }
@@ -1,35 +1,36 @@
 #include <mg/data/mzp.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mzp_compress");
   if (argc < 3) {
     fprintf(stderr, "%s output input [input..]\n", argv[0]);
     return -1;
   }
 
-  // Constrct new MZP
-  mg::data::Mzp mzp;
-
-  // Read each input file as a new MZP record
+  // Map each input file as a new MZP record
+  std::vector<std::unique_ptr<mg::fs::MappedFile>> inputs;
+  mg::data::MzpWriter writer;
   for (int i = 2; i < argc; i++) {
-    std::string entry_data;
-    if (!mg::fs::read_file(argv[i], entry_data)) {
+    auto entry_data = mg::fs::MappedFile::open(argv[i]);
+    if (entry_data == nullptr) {
+      fprintf(stderr, "Failed to open '%s'\n", argv[i]);
       return -1;
     }
 
     fprintf(stderr, "Adding file %s\n", argv[i]);
-    mzp.entry_headers.emplace_back();
-    mzp.entry_data.emplace_back(entry_data);
+    writer.add_entry(entry_data->string_view());
+    inputs.emplace_back(std::move(entry_data));
   }
 
   // Write out the archive
-  std::string mzp_out;
-  mg::data::mzp_write(mzp, mzp_out);
-  if (!mg::fs::write_file(argv[1], mzp_out)) {
+  auto output = mg::fs::FileWriter::open(argv[1], writer.size());
+  if (output == nullptr || !writer.write(output->fd()) || !output->commit()) {
     return -1;
   }
-  fprintf(stderr, "Wrote %ld bytes to %s\n", mzp_out.size(), argv[1]);
+  fprintf(stderr, "Wrote %ld bytes to %s\n", writer.size(), argv[1]);
 
   return 0;
 }
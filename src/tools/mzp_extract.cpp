@@ -1,30 +1,35 @@
 #include <mg/data/mzp.hpp>
+#include <mg/util/batch_io.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
 
 #include <filesystem>
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mzp_extract");
   if (argc != 2 && argc != 3) {
     fprintf(stderr, "%s infile [out_dir]\n", argv[0]);
     return -1;
   }
 
-  // Read input file
-  std::string archive_data;
-  if (!mg::fs::read_file(argv[1], archive_data)) {
+  // Map input file
+  std::shared_ptr<mg::fs::MappedFile> archive_data =
+      mg::fs::MappedFile::open(argv[1]);
+  if (archive_data == nullptr) {
+    fprintf(stderr, "Failed to open '%s'\n", argv[1]);
     return -1;
   }
 
   // Extract header
-  mg::data::Mzp mzp;
-  if (!mg::data::mzp_read(archive_data, mzp)) {
+  auto mzp = mg::data::MappedMzp::parse(archive_data);
+  if (mzp == nullptr) {
     fprintf(stderr, "Failed to parse archive\n");
     return -1;
   }
 
   // If we are putting output in a specific folder, check it exists
-  if (!std::filesystem::exists(argv[2])) {
+  if (argc == 3 && !std::filesystem::exists(argv[2])) {
     fprintf(stderr, "Output directory '%s' does not exist, exiting\n", argv[2]);
     return -1;
   }
@@ -40,12 +45,16 @@ int main(int argc, char **argv) {
   };
 
   // Split MZP into constituent files
-  for (unsigned i = 0; i < mzp.entry_headers.size(); i++) {
-    std::string path = output_path(i);
-    auto &data = mzp.entry_data[i];
-    if (!mg::fs::write_file(path.c_str(), data)) {
-      return -1;
-    }
+  auto writer = mg::fs::BatchWriter::create();
+  std::vector<std::string> paths;
+  for (unsigned i = 0; i < mzp->entries().size(); i++) {
+    paths.push_back(output_path(i));
+    writer->write_file(paths.back(), mzp->entry_data(i));
+  }
+  if (!writer->flush()) {
+    return -1;
+  }
+  for (auto &path : paths) {
     fprintf(stderr, "Wrote %s\n", path.c_str());
   }
 
@@ -1,43 +1,39 @@
 #include <mg/data/mzp.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mzp_info");
   if (argc != 2) {
     fprintf(stderr, "%s infile\n", argv[0]);
     return -1;
   }
 
-  // Read input file
-  std::string archive_data;
-  if (!mg::fs::read_file(argv[1], archive_data)) {
+  // Map input file
+  std::shared_ptr<mg::fs::MappedFile> archive_data =
+      mg::fs::MappedFile::open(argv[1]);
+  if (archive_data == nullptr) {
+    fprintf(stderr, "Failed to open '%s'\n", argv[1]);
     return -1;
   }
 
   // Extract header
-  mg::data::Mzp mzp;
-  if (!mg::data::mzp_read(archive_data, mzp)) {
+  auto mzp = mg::data::MappedMzp::parse(archive_data);
+  if (mzp == nullptr) {
     fprintf(stderr, "Failed to parse archive\n");
     return -1;
   }
 
-  fprintf(stderr, "MZP archive of %lu elements:\n", mzp.entry_headers.size());
-  for (auto &header : mzp.entry_headers) {
+  fprintf(stderr, "MZP archive of %lu elements:\n", mzp->entries().size());
+  for (auto &header : mzp->entries()) {
     header.print();
   }
 
-  for (unsigned i = 0; i < mzp.entry_headers.size(); i++) {
-    for (unsigned j = i + 1; j < mzp.entry_headers.size(); j++) {
-      // Do these ranges overlap
-      auto &entry_i = mzp.entry_headers[i];
-      auto &entry_j = mzp.entry_headers[j];
-      const uint32_t entry_i_start = entry_i.data_offset_relative();
-      const uint32_t entry_i_end = entry_i_start + entry_i.entry_data_size();
-      const uint32_t entry_j_start = entry_j.data_offset_relative();
-      if (entry_j_start >= entry_i_start && entry_j_start <= entry_i_end) {
-        fprintf(stderr, "Entry %u begins inside of entry %u\n", j, i);
-      }
-    }
+  // Overlaps are found when the archive is parsed
+  for (auto &overlap : mzp->overlaps()) {
+    fprintf(stderr, "Entry %u begins inside of entry %u\n", overlap.second,
+            overlap.first);
   }
 
   return 0;
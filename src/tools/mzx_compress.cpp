@@ -1,27 +1,36 @@
 #include <mg/data/mzx.hpp>
 #include <mg/util/fs.hpp>
+#include <mg/util/trace.hpp>
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mzx_compress");
   if (argc != 3) {
     fprintf(stderr, "%s infile outfile\n", argv[0]);
     return -1;
   }
 
-  // Read input file
-  std::string raw;
-  if (!mg::fs::read_file(argv[1], raw)) {
+  // Map input file
+  auto raw = mg::fs::MappedFile::open(argv[1]);
+  if (raw == nullptr) {
+    fprintf(stderr, "Failed to open '%s'\n", argv[1]);
     return -1;
   }
 
-  // Decompress
-  std::string compressed;
-  if (!mg::data::mzx_compress(raw, compressed)) {
+  // Compress straight into a worst case sized output mapping
+  auto compressed = mg::fs::MappedFile::create(
+      argv[2], mg::data::mzx_compress_bound(raw->size()));
+  if (compressed == nullptr) {
+    return -1;
+  }
+  size_t compressed_size = compressed->size();
+  if (!mg::data::mzx_compress(raw->string_view(), compressed->mutable_data(),
+                              compressed_size)) {
     fprintf(stderr, "Compress failed\n");
     return -1;
   }
 
   // Emit
-  if (!mg::fs::write_file(argv[2], compressed)) {
+  if (!compressed->finalize(compressed_size)) {
     return -1;
   }
 
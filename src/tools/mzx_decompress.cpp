@@ -1,27 +1,43 @@
 #include <mg/data/mzx.hpp>
 #include <mg/util/fs.hpp>
+#include <mg/util/trace.hpp>
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "mzx_decompress");
   if (argc != 3) {
     fprintf(stderr, "%s infile outfile\n", argv[0]);
     return -1;
   }
 
-  // Read input file
-  std::string compressed;
-  if (!mg::fs::read_file(argv[1], compressed)) {
+  // Map input file
+  auto compressed = mg::fs::MappedFile::open(argv[1]);
+  if (compressed == nullptr) {
+    fprintf(stderr, "Failed to open '%s'\n", argv[1]);
     return -1;
   }
 
-  // Decompress
-  std::string decompressed;
-  if (!mg::data::mzx_decompress(compressed, decompressed)) {
+  // The header tells us exactly how large the output will be
+  uint32_t decompressed_size;
+  if (!mg::data::mzx_decompressed_size(compressed->string_view(),
+                                       decompressed_size)) {
+    fprintf(stderr, "Decompress failed\n");
+    return -1;
+  }
+
+  // Decompress straight into the output mapping
+  auto decompressed = mg::fs::MappedFile::create(argv[2], decompressed_size);
+  if (decompressed == nullptr) {
+    return -1;
+  }
+  if (!mg::data::mzx_decompress(compressed->string_view(),
+                                decompressed->mutable_data(),
+                                decompressed->size())) {
     fprintf(stderr, "Decompress failed\n");
     return -1;
   }
 
   // Emit
-  if (!mg::fs::write_file(argv[2], decompressed)) {
+  if (!decompressed->finalize()) {
     return -1;
   }
 
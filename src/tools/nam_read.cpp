@@ -1,27 +1,31 @@
 #include <mg/data/nam.hpp>
 #include <mg/util/fs.hpp>
+#include <mg/util/trace.hpp>
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "nam_read");
   if (argc != 2) {
     fprintf(stderr, "%s infile\n", argv[0]);
     return -1;
   }
 
-  // Read input file
-  std::string archive_data;
-  if (!mg::fs::read_file(argv[1], archive_data)) {
+  // Map input file
+  std::shared_ptr<mg::fs::MappedFile> archive_data =
+      mg::fs::MappedFile::open(argv[1]);
+  if (archive_data == nullptr) {
+    fprintf(stderr, "Failed to open '%s'\n", argv[1]);
     return -1;
   }
 
   // Parse nam
-  mg::data::Nam nam;
-  if (!mg::data::nam_read(archive_data, nam)) {
+  auto nam = mg::data::NamView::parse(archive_data);
+  if (nam == nullptr) {
     fprintf(stderr, "Failed to parse file\n");
     return -1;
   }
 
-  for (auto &name : nam.names) {
-    printf("%s\n", name.c_str());
+  for (auto &name : nam->names()) {
+    printf("%.*s\n", (int)name.size(), name.data());
   }
 
   return 0;
@@ -1,10 +1,12 @@
 #include <mg/data/nxx.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
 
 #include <filesystem>
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "nxgx_compress");
   if (argc != 3) {
     fprintf(stderr, "%s input output\n", argv[0]);
     return -1;
@@ -14,21 +16,28 @@ int main(int argc, char **argv) {
   const char *input_file = argv[1];
   const char *output_file = argv[2];
 
-  // Read raw input data
-  std::string raw;
-  if (!mg::fs::read_file(input_file, raw)) {
+  // Map raw input data
+  auto raw = mg::fs::MappedFile::open(input_file);
+  if (raw == nullptr) {
+    fprintf(stderr, "Failed to open '%s'\n", input_file);
     return -1;
   }
 
-  // Compress
-  std::string compressed;
-  if (!mg::data::nxgx_compress(raw, compressed)) {
+  // Compress straight into a worst case sized output mapping
+  auto compressed = mg::fs::MappedFile::create(
+      output_file, mg::data::nxgx_compress_bound(raw->size()));
+  if (compressed == nullptr) {
+    return -1;
+  }
+  size_t compressed_size = compressed->size();
+  if (!mg::data::nxgx_compress(raw->string_view(), compressed->mutable_data(),
+                               compressed_size)) {
     fprintf(stderr, "Failed to compress\n");
     return -1;
   }
 
   // Write
-  if (!mg::fs::write_file(output_file, compressed)) {
+  if (!compressed->finalize(compressed_size)) {
     return -1;
   }
 
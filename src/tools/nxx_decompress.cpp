@@ -1,10 +1,12 @@
 #include <mg/data/nxx.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
 
 #include <filesystem>
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "nxx_decompress");
   if (argc != 3) {
     fprintf(stderr, "%s input output\n", argv[0]);
     return -1;
@@ -14,21 +16,34 @@ int main(int argc, char **argv) {
   const char *input_file = argv[1];
   const char *output_file = argv[2];
 
-  // Read raw input data
-  std::string raw;
-  if (!mg::fs::read_file(input_file, raw)) {
+  // Map raw input data
+  auto raw = mg::fs::MappedFile::open(input_file);
+  if (raw == nullptr) {
+    fprintf(stderr, "Failed to open '%s'\n", input_file);
     return -1;
   }
 
-  // Decompress
-  std::string decompressed;
-  if (!mg::data::nxx_decompress(raw, decompressed)) {
+  // The header tells us exactly how large the output will be
+  mg::data::Nxx header;
+  if (!mg::data::extract_nxx_header(raw->string_view(), header)) {
+    fprintf(stderr, "Failed to decompress\n");
+    return -1;
+  }
+
+  // Decompress straight into the output mapping
+  auto decompressed = mg::fs::MappedFile::create(output_file, header.size);
+  if (decompressed == nullptr) {
+    return -1;
+  }
+  if (!mg::data::nxx_decompress(raw->string_view(),
+                                decompressed->mutable_data(),
+                                decompressed->size())) {
     fprintf(stderr, "Failed to decompress\n");
     return -1;
   }
 
   // Write
-  if (!mg::fs::write_file(output_file, decompressed)) {
+  if (!decompressed->finalize()) {
     return -1;
   }
 
@@ -1,219 +1,396 @@
-#include <filesystem>
+#include <stddef.h>
+#include <string.h>
 
-#include <json.hpp>
+#include <atomic>
+#include <filesystem>
+#include <sstream>
 
 #include <mg.hpp>
 #include <mg/data/mzp.hpp>
+#include <mg/data/string_table.hpp>
+#include <mg/data/translation_index.hpp>
 #include <mg/util/crypto.hpp>
-#include <mg/util/endian.hpp>
 #include <mg/util/fs.hpp>
 #include <mg/util/string.hpp>
+#include <mg/util/thread_pool.hpp>
+#include <mg/util/trace.hpp>
 
 static const std::string TARGET_LANGUAGE = "en";
 
-std::vector<uint32_t>
-parse_offset_table(const std::string &string_offsets_raw) {
-  // Extract the string offset table
-  const uint32_t *string_offsets_u32 =
-      reinterpret_cast<const uint32_t *>(string_offsets_raw.data());
-  const unsigned string_offset_count =
-      string_offsets_raw.size() / sizeof(uint32_t);
-  std::vector<uint32_t> string_data_offsets;
-  string_data_offsets.resize(string_offset_count);
-  for (unsigned i = 0; i < string_offset_count; i++) {
-    string_data_offsets[i] = mg::be_to_host_u32(string_offsets_u32[i]);
-  }
-  return string_data_offsets;
-}
+// Patched string table pairs can be cached on disk. Each entry is keyed by the
+// hash of the original pair, and holds the digests of its lines, the hash of
+// the DB text those lines mapped to, and the patched pair. As long as the DB
+// gives the same text for every line, the patched pair is reused as-is.
+// The cache is local to a machine, so integers are in host order.
+struct __attribute__((__packed__)) CacheEntryHeader {
+  static constexpr const char *MAGIC = "MGRPKC01";
+  char magic[8];
+  uint8_t db_subset_hash[SHA256_DIGEST_LENGTH];
+  uint32_t line_count;
+  uint32_t offset_table_size;
+  uint32_t string_data_size;
+};
+
+struct CacheEntry {
+  std::shared_ptr<mg::fs::MappedFile> backing_data;
+  std::string_view db_subset_hash;
+  std::string_view line_digests;
+  std::string_view offset_table;
+  std::string_view string_data;
+};
+
+std::unique_ptr<CacheEntry> cache_load(const std::string &path) {
+  MG_TRACE_SCOPE(TRACE_READ, "cache_load");
+  if (!std::filesystem::exists(path)) {
+    return nullptr;
+  }
+  std::shared_ptr<mg::fs::MappedFile> backing_data =
+      mg::fs::MappedFile::open(path.c_str());
+  if (backing_data == nullptr) {
+    return nullptr;
+  }
 
-std::vector<std::string>
-extract_string_table(const std::string &string_data_raw,
-                     const std::vector<uint32_t> &string_offsets) {
-  // Now that we have offsets, iterate the string data and extract from each
-  // start offset until we hit \r\n
-  const char *const end_ptr = &string_data_raw[string_data_raw.size() - 1];
-  std::vector<std::string> string_data;
-  for (uint32_t offset : string_offsets) {
-    // Have we hit EOF?
-    if (offset == 0xFFFFFFFF) {
-      break;
-    }
+  // Anything malformed is just a miss
+  const std::string_view data = backing_data->string_view();
+  if (data.size() < sizeof(CacheEntryHeader)) {
+    return nullptr;
+  }
+  CacheEntryHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+  const size_t digests_size =
+      (size_t)header.line_count * SHA256_DIGEST_LENGTH;
+  if (memcmp(header.magic, CacheEntryHeader::MAGIC, sizeof(header.magic)) ||
+      data.size() != sizeof(header) + digests_size + header.offset_table_size +
+                         header.string_data_size) {
+    return nullptr;
+  }
 
-    // Get a pointer to the start of string
-    const char *const start = &string_data_raw[offset];
-
-    // Seek for \r\n
-    const char *seek_r = start;
-    const char *seek_n = start + 1;
-    bool found_end = false;
-    while (seek_n <= end_ptr &&
-           !(found_end = (*seek_r == '\r' && *seek_n == '\n'))) {
-      seek_r++;
-      seek_n++;
-    }
+  std::unique_ptr<CacheEntry> ret(new CacheEntry);
+  ret->backing_data = backing_data;
+  ret->db_subset_hash =
+      data.substr(offsetof(CacheEntryHeader, db_subset_hash),
+                  SHA256_DIGEST_LENGTH);
+  size_t offset = sizeof(header);
+  ret->line_digests = data.substr(offset, digests_size);
+  offset += digests_size;
+  ret->offset_table = data.substr(offset, header.offset_table_size);
+  offset += header.offset_table_size;
+  ret->string_data = data.substr(offset, header.string_data_size);
+  return ret;
+}
+
+bool cache_store(const std::string &path, const std::string &db_subset_hash,
+                 const std::string_view &line_digests,
+                 const std::string &offset_table,
+                 const std::string &string_data) {
+  MG_TRACE_SCOPE(TRACE_WRITE, "cache_store");
+  CacheEntryHeader header;
+  memcpy(header.magic, CacheEntryHeader::MAGIC, sizeof(header.magic));
+  memcpy(header.db_subset_hash, db_subset_hash.data(), SHA256_DIGEST_LENGTH);
+  header.line_count = line_digests.size() / SHA256_DIGEST_LENGTH;
+  header.offset_table_size = offset_table.size();
+  header.string_data_size = string_data.size();
+
+  auto output = mg::fs::FileWriter::open(
+      path.c_str(), sizeof(header) + line_digests.size() +
+                        offset_table.size() + string_data.size());
+  return output != nullptr &&
+         output->write(std::string_view(reinterpret_cast<char *>(&header),
+                                        sizeof(header))) &&
+         output->write(line_digests) && output->write(offset_table) &&
+         output->write(string_data) && output->commit();
+}
 
-    // Scoop the data from start to seek_r into a string
-    if (found_end) {
-      string_data.emplace_back(start, seek_r - start);
-    } else {
-      fprintf(stderr, "Warning - failed to load string at offset %08x\n",
-              offset);
+// Look up the translation of each line (empty if there is none), and hash
+// the result. Lines that map to the same text under two DBs produce the
+// same subset hash.
+std::string
+translate_lines(const mg::data::MappedTranslationIndex &translation_db,
+                int language, const std::string_view &line_digests,
+                std::vector<std::string_view> &translations) {
+  MG_TRACE_SCOPE(TRACE_HASH, "translate_lines");
+  const size_t line_count = line_digests.size() / SHA256_DIGEST_LENGTH;
+  translations.clear();
+  translations.resize(line_count);
+  std::string hash_input;
+  for (size_t i = 0; i < line_count; i++) {
+    const std::string_view digest =
+        line_digests.substr(i * SHA256_DIGEST_LENGTH, SHA256_DIGEST_LENGTH);
+    uint32_t size = 0xFFFFFFFF;
+    if (language >= 0 &&
+        translation_db.find(digest, language, translations[i])) {
+      size = translations[i].size();
     }
+    hash_input.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    hash_input.append(translations[i]);
   }
-
-  return string_data;
+  return mg::util::sha256(hash_input);
 }
 
-mg::data::Mzp patch_string_table(const nlohmann::json &translation_db,
-                                 const mg::data::Mzp mzp_archive) {
+std::vector<std::string>
+patch_string_table(const mg::data::MappedTranslationIndex &translation_db,
+                   const mg::data::MappedMzp &mzp_archive,
+                   mg::util::ThreadPool *pool, const char *cache_dir) {
   // The MZP archive consists of N pairs of string offset table + string data
   // table. For each pair, iterate the string table, extract the string, hash
   // it, check if the translated string exists, and if so inject the translated
   // string instead.
-  ASSERT(mzp_archive.entry_headers.size() == mzp_archive.entry_data.size());
-  ASSERT(mzp_archive.entry_headers.size() % 2 == 0);
+  ASSERT(mzp_archive.entries().size() % 2 == 0);
+
+  // Return MZP sections
+  std::vector<std::string> ret;
 
-  // Return MZP
-  mg::data::Mzp ret;
+  // A DB with no text at all for the target language just passes the script
+  // through
+  const int language = translation_db.language_index(TARGET_LANGUAGE);
+  if (language < 0) {
+    fprintf(stderr, "Warning - translation db has no '%s' text\n",
+            TARGET_LANGUAGE.c_str());
+  }
 
-  for (unsigned i = 0; i < mzp_archive.entry_headers.size(); i += 2) {
+  std::vector<std::string_view> translations;
+  for (unsigned i = 0; i < mzp_archive.entries().size(); i += 2) {
     const unsigned offset_table_idx = i;
     const unsigned string_table_idx = i + 1;
-
-    // Extract original strings
-    const std::vector<uint32_t> offsets =
-        parse_offset_table(mzp_archive.entry_data[offset_table_idx]);
-    const std::vector<std::string> original_strings =
-        extract_string_table(mzp_archive.entry_data[string_table_idx], offsets);
-    fprintf(stderr, "Loaded %lu strings from tables %u+%u\n",
-            original_strings.size(), offset_table_idx, string_table_idx);
-
-    // Iterate the strings, and replace any translated ones with the appropriate
-    // text
-    std::vector<std::string> translated_strings;
-    for (auto &line : original_strings) {
-      // Hash the line
-      const std::string line_digest_hex =
-          mg::string::bytes_to_hex(mg::util::sha256(line));
-
-      // If we find nothing, fall back to the original text
-      std::string line_to_insert = line;
-
-      // Is this hash in our TL DB?
-      auto &script_text_by_hash = translation_db["script_text_by_hash"];
-      if (script_text_by_hash.contains(line_digest_hex)) {
-        if (script_text_by_hash[line_digest_hex].contains(TARGET_LANGUAGE)) {
-          const std::string translated_line =
-              script_text_by_hash[line_digest_hex][TARGET_LANGUAGE];
-          if (translated_line.size() > 0) {
-            // We have a translation
-            line_to_insert = translated_line;
-          }
-        }
+    const std::string_view offset_table_raw =
+        mzp_archive.entry_data(offset_table_idx);
+    const std::string_view string_table_raw =
+        mzp_archive.entry_data(string_table_idx);
+
+    // If this exact pair has been patched before, and the DB text for its
+    // lines is unchanged, copy the old output straight through
+    std::string cache_path;
+    if (cache_dir != nullptr) {
+      // Sizes first, so that no other split of the same bytes between the
+      // two tables shares a key
+      const uint64_t table_sizes[2] = {offset_table_raw.size(),
+                                       string_table_raw.size()};
+      uint8_t table_hash[SHA256_DIGEST_LENGTH];
+      mg::util::sha256(
+          {std::string_view(reinterpret_cast<const char *>(table_sizes),
+                            sizeof(table_sizes)),
+           offset_table_raw, string_table_raw},
+          table_hash);
+      cache_path = std::filesystem::path(cache_dir).append(
+          mg::string::bytes_to_hex(std::string_view(
+              reinterpret_cast<const char *>(table_hash), sizeof(table_hash))));
+      auto cached = cache_load(cache_path);
+      if (cached != nullptr &&
+          translate_lines(translation_db, language, cached->line_digests,
+                          translations) == cached->db_subset_hash) {
+        fprintf(stderr, "Reused %lu strings for tables %u+%u from cache\n",
+                translations.size(), offset_table_idx, string_table_idx);
+        ret.emplace_back(cached->offset_table);
+        ret.emplace_back(cached->string_data);
+        continue;
       }
-
-      // Append the line to our output vector
-      translated_strings.emplace_back(line_to_insert);
     }
 
-    // Now that we have a vector of translated strings, we need to insert them
-    // back into the MZP and update the offset table.
-    // Note that during reinsertion, we re-add the \r\n escape sequence at the
-    // end of each line
-    std::vector<uint32_t> new_text_offsets;
-    std::string new_text_data;
-    uint32_t text_write_offset = 0;
-    for (auto &line : translated_strings) {
-      // Append \r\n
-      const std::string padded_line = line + "\r\n";
-
-      // Append this string to our buffer
-      new_text_data.resize(new_text_data.size() + padded_line.size());
-      memcpy(&new_text_data[text_write_offset], padded_line.data(),
-             padded_line.size());
-
-      // Add that offset for this string to the offset table
-      new_text_offsets.emplace_back(text_write_offset);
-
-      // Increment the write pointer by the size of the string
-      text_write_offset += padded_line.size();
+    // Extract original strings
+    std::vector<std::string_view> lines;
+    mg::data::string_table_read(offset_table_raw, string_table_raw, lines);
+    fprintf(stderr, "Loaded %lu strings from tables %u+%u\n", lines.size(),
+            offset_table_idx, string_table_idx);
+
+    // Hash all of the lines up front, and find their translations
+    const mg::util::Sha256Digests digests = mg::util::sha256_many(lines, pool);
+    const std::string db_subset_hash =
+        translate_lines(translation_db, language, digests.data, translations);
+
+    // Replace any translated lines with the appropriate text. If we find
+    // nothing, fall back to the original text
+    for (size_t line_idx = 0; line_idx < lines.size(); line_idx++) {
+      if (translations[line_idx].size() > 0) {
+        lines[line_idx] = translations[line_idx];
+      }
     }
 
-    // For some reason, the offsets seem to include 2 instances of offsets that
-    // point to the final byte of the string table. Recreate them here in case
-    // the game actually needs this info.
-    new_text_offsets.emplace_back(new_text_data.size());
-    new_text_offsets.emplace_back(new_text_data.size());
-
-    // The offset table ends with 12 bytes of 0xFF
-    new_text_offsets.emplace_back(0xFFFFFFFF);
-    new_text_offsets.emplace_back(0xFFFFFFFF);
-    new_text_offsets.emplace_back(0xFFFFFFFF);
-
-    // Now that we have the new string data, and the new list of offsets, pack
-    // the list of offsets back into a byte array
+    // Now that we have the translated strings, we need to insert them back
+    // into the MZP and rebuild the offset table
     std::string serialized_new_offsets;
-    serialized_new_offsets.resize(new_text_offsets.size() * sizeof(uint32_t));
-    uint32_t offset_write_offset = 0;
-    for (uint32_t offset : new_text_offsets) {
-      const uint32_t be_offset = mg::host_to_be_u32(offset);
-      memcpy(&serialized_new_offsets[offset_write_offset], &be_offset,
-             sizeof(be_offset));
-      offset_write_offset += sizeof(uint32_t);
+    std::string new_text_data;
+    mg::data::string_table_write(lines, serialized_new_offsets, new_text_data);
+
+    // Remember the result for next time. Failing to is not fatal.
+    if (cache_dir != nullptr &&
+        !cache_store(cache_path, db_subset_hash, digests.data,
+                     serialized_new_offsets, new_text_data)) {
+      fprintf(stderr, "Warning - failed to update cache '%s'\n",
+              cache_path.c_str());
     }
 
     // Add the new segments to our output MZP
-    ret.add_entry(serialized_new_offsets);
-    ret.add_entry(new_text_data);
+    ret.emplace_back(std::move(serialized_new_offsets));
+    ret.emplace_back(std::move(new_text_data));
   }
 
   return ret;
 }
 
-int main(int argc, char **argv) {
-  if (argc != 4) {
-    fprintf(stderr, "%s translation_db.json script_in.mrg script_out.mrg\n",
-            argv[0]);
-    return -1;
+// Load a translation DB. A precompiled index is used as-is, JSON is compiled
+// to an index in memory first, which is kept in `compiled_db`.
+std::unique_ptr<mg::data::MappedTranslationIndex>
+load_translation_db(const char *path, std::string &compiled_db) {
+  std::shared_ptr<mg::fs::MappedFile> translation_db_raw =
+      mg::fs::MappedFile::open(path);
+  if (translation_db_raw == nullptr) {
+    fprintf(stderr, "Failed to read translation db from '%s'\n", path);
+    return nullptr;
   }
+  std::unique_ptr<mg::data::MappedTranslationIndex> translation_db;
+  const std::string_view db_data = translation_db_raw->string_view();
+  if (db_data.substr(0, strlen(mg::data::TranslationIndex::FILE_MAGIC)) ==
+      mg::data::TranslationIndex::FILE_MAGIC) {
+    translation_db =
+        mg::data::MappedTranslationIndex::parse(translation_db_raw);
+  } else if (mg::data::translation_index_compile_json(db_data, compiled_db)) {
+    translation_db = mg::data::MappedTranslationIndex::parse(compiled_db);
+  }
+  if (translation_db == nullptr) {
+    fprintf(stderr, "Failed to load translation db from '%s'\n", path);
+  }
+  return translation_db;
+}
 
-  // Name args
-  const char *translation_db_filename = argv[1];
-  const char *input_mrg = argv[2];
-  const char *output_mrg = argv[3];
-
-  // Try and load input script text
-  std::string script_text_raw;
-  if (!mg::fs::read_file(input_mrg, script_text_raw)) {
+bool repack_archive(const mg::data::MappedTranslationIndex &translation_db,
+                    const char *input_mrg, const char *output_mrg,
+                    mg::util::ThreadPool *pool, const char *cache_dir) {
+  MG_TRACE_SCOPE(TRACE_ENCODE, "repack_archive");
+  // Try and map input script text
+  std::shared_ptr<mg::fs::MappedFile> script_text_raw =
+      mg::fs::MappedFile::open(input_mrg);
+  if (script_text_raw == nullptr) {
     fprintf(stderr, "Failed to read script text from '%s'\n", input_mrg);
-    return -1;
+    return false;
   }
 
   // Attempt to parse script text as MZP archive
-  mg::data::Mzp mzp;
-  if (!mg::data::mzp_read(script_text_raw, mzp)) {
+  auto mzp = mg::data::MappedMzp::parse(script_text_raw);
+  if (mzp == nullptr) {
     fprintf(stderr, "Failed to parse script data as MZP\n");
-    return -1;
+    return false;
   }
-
-  // Try and load the translation DB
-  std::string translation_db_raw;
-  if (!mg::fs::read_file(translation_db_filename, translation_db_raw)) {
-    fprintf(stderr, "Failed to translation db from '%s'\n",
-            translation_db_filename);
-    return -1;
+  if (mzp->entries().size() % 2 != 0) {
+    fprintf(stderr, "Script data in '%s' has an odd number of entries\n",
+            input_mrg);
+    return false;
   }
-  nlohmann::json translation_db = nlohmann::json::parse(translation_db_raw);
 
   // Retranslate the script
-  mg::data::Mzp translated_mzp = patch_string_table(translation_db, mzp);
+  const std::vector<std::string> translated_sections =
+      patch_string_table(translation_db, *mzp, pool, cache_dir);
 
   // Write out the translated archive
-  std::string mzp_out;
-  mg::data::mzp_write(translated_mzp, mzp_out);
-  if (!mg::fs::write_file(output_mrg, mzp_out)) {
+  mg::data::MzpWriter writer;
+  for (auto &section : translated_sections) {
+    writer.add_entry(section);
+  }
+  auto output = mg::fs::FileWriter::open(output_mrg, writer.size());
+  return output != nullptr && writer.write(output->fd()) && output->commit();
+}
+
+// Repack every input/output pair listed in a manifest, one archive per task.
+// Hashing within an archive then stays on its worker.
+bool repack_manifest(const mg::data::MappedTranslationIndex &translation_db,
+                     const char *manifest_path, mg::util::ThreadPool &pool,
+                     const char *cache_dir) {
+  std::string manifest_raw;
+  if (!mg::fs::read_file(manifest_path, manifest_raw)) {
+    fprintf(stderr, "Failed to read manifest '%s'\n", manifest_path);
+    return false;
+  }
+
+  // One whitespace separated pair per line. Blank lines and lines starting
+  // with # are skipped.
+  std::vector<std::pair<std::string, std::string>> jobs;
+  std::istringstream manifest(manifest_raw);
+  std::string line;
+  for (unsigned line_number = 1; std::getline(manifest, line);
+       line_number++) {
+    std::istringstream fields(line);
+    std::string input, output, extra;
+    if (!(fields >> input) || input[0] == '#') {
+      continue;
+    }
+    if (!(fields >> output) || (fields >> extra)) {
+      fprintf(stderr, "%s:%u: expected 'input output'\n", manifest_path,
+              line_number);
+      return false;
+    }
+    jobs.emplace_back(input, output);
+  }
+
+  std::atomic<unsigned> failed{0};
+  for (auto &job : jobs) {
+    pool.submit([&]() {
+      if (!repack_archive(translation_db, job.first.c_str(),
+                          job.second.c_str(), nullptr, cache_dir)) {
+        fprintf(stderr, "Failed to repack '%s'\n", job.first.c_str());
+        failed++;
+      }
+    });
+  }
+  pool.wait_idle();
+
+  fprintf(stderr, "Repacked %lu of %lu archives\n", jobs.size() - failed,
+          jobs.size());
+  return failed == 0;
+}
+
+void usage(const char *program_name) {
+  fprintf(stderr,
+          "%s [--cache cache_dir] translation_db.{json,idx} script_in.mrg "
+          "script_out.mrg\n"
+          "%s [--cache cache_dir] --manifest manifest.txt "
+          "translation_db.{json,idx}\n"
+          "  Each manifest line is a whitespace separated input/output pair\n",
+          program_name, program_name);
+}
+
+int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "repack_script_text_translation");
+  // Parse args
+  const char *cache_dir = nullptr;
+  const char *manifest_path = nullptr;
+  std::vector<const char *> positional;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp("--cache", argv[i]) && i + 1 < argc) {
+      cache_dir = argv[++i];
+      continue;
+    }
+    if (!strcmp("--manifest", argv[i]) && i + 1 < argc) {
+      manifest_path = argv[++i];
+      continue;
+    }
+    positional.push_back(argv[i]);
+  }
+  if (positional.size() != (manifest_path ? 1 : 3)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // Ensure the cache dir exists
+  if (cache_dir != nullptr && !std::filesystem::exists(cache_dir) &&
+      !std::filesystem::create_directories(cache_dir)) {
+    fprintf(stderr, "Failed to create cache dir '%s'\n", cache_dir);
     return -1;
   }
 
-  return 0;
+  // The DB is loaded once, however many archives there are
+  std::string compiled_db;
+  auto translation_db = load_translation_db(positional[0], compiled_db);
+  if (translation_db == nullptr) {
+    return -1;
+  }
+
+  mg::util::ThreadPool pool;
+  if (manifest_path != nullptr) {
+    return repack_manifest(*translation_db, manifest_path, pool, cache_dir)
+               ? 0
+               : -1;
+  }
+  return repack_archive(*translation_db, positional[1], positional[2], &pool,
+                        cache_dir)
+             ? 0
+             : -1;
 }
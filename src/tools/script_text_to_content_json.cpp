@@ -1,22 +1,17 @@
+#include <algorithm>
 #include <filesystem>
 
-#include <openssl/sha.h>
-
-#include <json.hpp>
-
 #include <mg/data/mzp.hpp>
-#include <mg/util/endian.hpp>
+#include <mg/data/string_table.hpp>
+#include <mg/util/crypto.hpp>
 #include <mg/util/fs.hpp>
+#include <mg/util/json.hpp>
 #include <mg/util/string.hpp>
-
-std::string sha256(const std::string &data) {
-  uint8_t digest[SHA256_DIGEST_LENGTH];
-  SHA256(reinterpret_cast<const uint8_t *>(data.data()), data.size(), digest);
-  return std::string{reinterpret_cast<const char *>(digest),
-                     SHA256_DIGEST_LENGTH};
-}
+#include <mg/util/thread_pool.hpp>
+#include <mg/util/trace.hpp>
 
 int main(int argc, char **argv) {
+  MG_TRACE_SCOPE(TRACE_TOOL, "script_text_to_content_json");
   if (argc != 3) {
     fprintf(stderr, "%s script_text.mrg out.json\n", argv[0]);
     return -1;
@@ -26,82 +21,78 @@ int main(int argc, char **argv) {
   const char *script_text_filename = argv[1];
   const char *output_filename = argv[2];
 
-  // Try and load script_text
-  std::string script_text_raw;
-  if (!mg::fs::read_file(script_text_filename, script_text_raw)) {
+  // Try and map script_text
+  std::shared_ptr<mg::fs::MappedFile> script_text_raw =
+      mg::fs::MappedFile::open(script_text_filename);
+  if (script_text_raw == nullptr) {
     fprintf(stderr, "Failed to read script text from '%s'\n",
             script_text_filename);
     return -1;
   }
 
   // Attempt to parse script text as MZP archive
-  mg::data::Mzp mzp;
-  if (!mg::data::mzp_read(script_text_raw, mzp)) {
+  auto mzp = mg::data::MappedMzp::parse(script_text_raw);
+  if (mzp == nullptr) {
     fprintf(stderr, "Failed to parse script data as MZP\n");
     return -1;
   }
 
-  // The script text consists of 10 entries, consisting of 5 pairs of string
-  // table offsets / string table data.
-  // All of the string tables other than the first pair seem to just contain a
-  // \r\n and nothing else.
-  if (mzp.entry_data.size() < 2) {
+  // The script text consists of pairs of string table offsets / string table
+  // data. Usually only the first pair holds any real text.
+  if (mzp->entries().size() < 2) {
     fprintf(stderr, "Script data does not contain enough entries\n");
     return -1;
   }
-
-  // Extract the string offset table
-  const std::string &string_offsets_raw = mzp.entry_data[0];
-  const uint32_t *string_offsets_u32 =
-      reinterpret_cast<const uint32_t *>(string_offsets_raw.data());
-  const unsigned string_offset_count =
-      string_offsets_raw.size() / sizeof(uint32_t);
-  std::vector<uint32_t> string_data_offsets;
-  string_data_offsets.resize(string_offset_count);
-  for (unsigned i = 0; i < string_offset_count; i++) {
-    string_data_offsets[i] = mg::be_to_host_u32(string_offsets_u32[i]);
+  std::vector<std::string_view> lines;
+  std::vector<std::string_view> table_lines;
+  for (unsigned i = 0; i + 1 < mzp->entries().size(); i += 2) {
+    mg::data::string_table_read(mzp->entry_data(i), mzp->entry_data(i + 1),
+                                table_lines);
+    lines.insert(lines.end(), table_lines.begin(), table_lines.end());
   }
 
-  // Now that we have offsets, iterate the string data and extract from each
-  // start offset until we hit \r\n
-  const std::string &string_data_raw = mzp.entry_data[1];
-  const char *const end_ptr = &string_data_raw[string_data_raw.size() - 1];
-  std::vector<std::string> string_data;
-  for (uint32_t offset : string_data_offsets) {
-    // Get a pointer to the start of string
-    const char *const start = &string_data_raw[offset];
+  // Generate a content hash for each string in parallel
+  mg::util::ThreadPool pool;
+  const mg::util::Sha256Digests digests = mg::util::sha256_many(lines, &pool);
 
-    // Seek for \r\n
-    const char *seek_r = start;
-    const char *seek_n = start + 1;
-    bool found_end = false;
-    while (seek_n < end_ptr &&
-           !(found_end = (*seek_r == '\r' && *seek_n == '\n'))) {
-      seek_r++;
-      seek_n++;
+  // Order the lines by hash, which is also the order of the hex keys, and
+  // drop repeated lines. Only indices are moved around, the text stays where
+  // it is in the mapped script.
+  std::vector<uint32_t> order(lines.size());
+  for (uint32_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return digests[a] < digests[b];
+  });
+  order.erase(std::unique(order.begin(), order.end(),
+                          [&](uint32_t a, uint32_t b) {
+                            return digests[a] == digests[b];
+                          }),
+              order.end());
+
+  // Stream the JSON out, in the same layout as nlohmann::json::dump(2)
+  auto output = mg::fs::FileWriter::open(output_filename);
+  if (output == nullptr) {
+    return -1;
+  }
+  std::string chunk = "{\n  \"script_text_by_hash\": {";
+  for (size_t i = 0; i < order.size(); i++) {
+    chunk += i == 0 ? "\n    \"" : ",\n    \"";
+    chunk += mg::string::bytes_to_hex(digests[order[i]]);
+    chunk += "\": {\n      \"en\": \"\",\n      \"jp\": ";
+    if (!mg::json::append_string(lines[order[i]], chunk)) {
+      fprintf(stderr, "Line %u is not valid UTF-8\n", order[i]);
+      return -1;
     }
-
-    // Scoop the data from start to seek_r into a string
-    if (found_end) {
-      string_data.emplace_back(start, seek_r - start);
+    chunk += ",\n      \"notes\": \"\"\n    }";
+    if (!output->write(chunk)) {
+      return -1;
     }
+    chunk.clear();
   }
-
-  // Generate a content hash for each string and encode as json
-  nlohmann::json j;
-  for (auto &string : string_data) {
-    const std::string digest_bytes = sha256(string);
-    const std::string digest_hex = mg::string::bytes_to_hex(digest_bytes);
-    j["script_text_by_hash"][digest_hex] = {
-        {"jp", string},
-        {"en", ""},
-        {"notes", ""},
-    };
-  }
-
-  // Serialize and emit
-  const std::string serialized_json = j.dump(2);
-  if (!mg::fs::write_file(output_filename, serialized_json)) {
+  chunk += order.empty() ? "}\n}" : "\n  }\n}";
+  if (!output->write(chunk) || !output->commit()) {
     fprintf(stderr, "Failed to write '%s'\n", output_filename);
     return -1;
   }
@@ -0,0 +1,459 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <mg/util/batch_io.hpp>
+#include <mg/util/fs.hpp>
+#include <mg/util/thread_pool.hpp>
+#include <mg/util/trace.hpp>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+namespace mg::fs {
+
+namespace {
+
+// Fallback: plain synchronous writes spread over a pool
+class PoolBatchWriter : public BatchWriter {
+public:
+  explicit PoolBatchWriter(unsigned thread_count) : _pool(thread_count) {}
+
+  void write_file(const std::string &path,
+                  const std::string_view &data) override {
+    _pool.submit([this, path, data]() {
+      if (!mg::fs::write_file(path.c_str(), data)) {
+        _failed = true;
+      }
+    });
+  }
+
+  bool flush() override {
+    MG_TRACE_SCOPE(TRACE_WRITE, "BatchWriter::flush");
+    _pool.wait_idle();
+    return !_failed.exchange(false);
+  }
+
+  const char *backend() const override { return "threads"; }
+
+private:
+  mg::util::ThreadPool _pool;
+  std::atomic<bool> _failed{false};
+};
+
+#ifdef IORING_RSRC_REGISTER_SPARSE
+
+class UringBatchWriter : public BatchWriter {
+public:
+  static std::unique_ptr<BatchWriter> create(unsigned queue_depth);
+  ~UringBatchWriter() override;
+
+  void write_file(const std::string &path,
+                  const std::string_view &data) override;
+  bool flush() override;
+  const char *backend() const override { return "io_uring"; }
+
+private:
+  // Largest single write op. The SQE length is 32 bits, and large writes are
+  // split into linked chunks anyway to keep each op bounded.
+  static constexpr size_t MAX_WRITE_CHUNK = 1u << 30;
+
+  // Part of a file's data still to be written
+  struct WriteRange {
+    size_t offset;
+    size_t size;
+  };
+
+  // One file in flight. Occupies one direct descriptor slot until every op in
+  // its chain has completed, and any short writes have been resumed.
+  struct Pending {
+    std::string path;
+    std::string_view data;
+    std::vector<WriteRange> writes;
+    std::vector<WriteRange> remaining;
+    unsigned ops_outstanding = 0;
+    bool failed = false;
+  };
+
+  UringBatchWriter(int ring_fd, unsigned queue_depth)
+      : _ring_fd(ring_fd), _slots(queue_depth) {}
+
+  bool map_rings(const struct io_uring_params &params);
+  struct io_uring_sqe *next_sqe();
+  unsigned sq_space() const;
+  bool submit_and_wait(unsigned min_complete);
+  void queue_chain(unsigned slot, int open_flags);
+  void reap();
+  bool resume_short_writes();
+
+  int _ring_fd;
+
+  // Submission ring
+  void *_sq_ring = MAP_FAILED;
+  size_t _sq_ring_size = 0;
+  unsigned *_sq_head;
+  unsigned *_sq_tail;
+  unsigned *_sq_mask;
+  unsigned *_sq_array;
+  unsigned _sq_entries;
+  struct io_uring_sqe *_sqes = (struct io_uring_sqe *)MAP_FAILED;
+  size_t _sqes_size = 0;
+  unsigned _to_submit = 0;
+
+  // Completion ring
+  void *_cq_ring = MAP_FAILED;
+  size_t _cq_ring_size = 0;
+  unsigned *_cq_head;
+  unsigned *_cq_tail;
+  unsigned *_cq_mask;
+  struct io_uring_cqe *_cqes;
+
+  // Direct descriptor slots, and the files using them
+  std::vector<Pending> _slots;
+  std::vector<unsigned> _free_slots;
+  std::vector<unsigned> _short_slots;
+  unsigned _in_flight = 0;
+  bool _failed = false;
+};
+
+int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                 nullptr, 0);
+}
+
+int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+std::unique_ptr<BatchWriter> UringBatchWriter::create(unsigned queue_depth) {
+  // Each file needs at least an open, a write and a close
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  const int ring_fd = io_uring_setup(queue_depth * 4, &params);
+  if (ring_fd < 0) {
+    return nullptr;
+  }
+
+  std::unique_ptr<UringBatchWriter> ret(
+      new UringBatchWriter(ring_fd, queue_depth));
+  if (!ret->map_rings(params)) {
+    return nullptr;
+  }
+
+  // Reserve an empty table of direct descriptors, one per slot
+  struct io_uring_rsrc_register reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.nr = queue_depth;
+  reg.flags = IORING_RSRC_REGISTER_SPARSE;
+  if (io_uring_register(ring_fd, IORING_REGISTER_FILES2, &reg, sizeof(reg)) <
+      0) {
+    return nullptr;
+  }
+
+  for (unsigned i = 0; i < queue_depth; i++) {
+    ret->_free_slots.push_back(queue_depth - 1 - i);
+  }
+  return ret;
+}
+
+bool UringBatchWriter::map_rings(const struct io_uring_params &params) {
+  _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  _cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    _sq_ring_size = _cq_ring_size =
+        std::max(_sq_ring_size, _cq_ring_size);
+  }
+
+  _sq_ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+  if (_sq_ring == MAP_FAILED) {
+    return false;
+  }
+  if (single_mmap) {
+    _cq_ring = _sq_ring;
+  } else {
+    _cq_ring = mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+    if (_cq_ring == MAP_FAILED) {
+      return false;
+    }
+  }
+
+  _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  _sqes = (struct io_uring_sqe *)mmap(nullptr, _sqes_size,
+                                      PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE, _ring_fd,
+                                      IORING_OFF_SQES);
+  if (_sqes == MAP_FAILED) {
+    return false;
+  }
+
+  uint8_t *sq = reinterpret_cast<uint8_t *>(_sq_ring);
+  _sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  _sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  _sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  _sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  _sq_entries = params.sq_entries;
+
+  uint8_t *cq = reinterpret_cast<uint8_t *>(_cq_ring);
+  _cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  _cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  _cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  _cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  return true;
+}
+
+UringBatchWriter::~UringBatchWriter() {
+  flush();
+  if (_sqes != MAP_FAILED) {
+    munmap(_sqes, _sqes_size);
+  }
+  if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring) {
+    munmap(_cq_ring, _cq_ring_size);
+  }
+  if (_sq_ring != MAP_FAILED) {
+    munmap(_sq_ring, _sq_ring_size);
+  }
+  close(_ring_fd);
+}
+
+struct io_uring_sqe *UringBatchWriter::next_sqe() {
+  const unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+  const unsigned tail = *_sq_tail;
+  if (tail - head >= _sq_entries) {
+    return nullptr;
+  }
+
+  const unsigned index = tail & *_sq_mask;
+  struct io_uring_sqe *sqe = &_sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  _sq_array[index] = index;
+  __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+  _to_submit++;
+  return sqe;
+}
+
+unsigned UringBatchWriter::sq_space() const {
+  return _sq_entries -
+         (*_sq_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE));
+}
+
+bool UringBatchWriter::submit_and_wait(unsigned min_complete) {
+  while (true) {
+    const int ret =
+        io_uring_enter(_ring_fd, _to_submit, min_complete,
+                       min_complete ? IORING_ENTER_GETEVENTS : 0);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "io_uring_enter failed - %s\n", strerror(errno));
+      return false;
+    }
+    _to_submit -= ret;
+    if (_to_submit == 0 || min_complete == 0) {
+      return true;
+    }
+  }
+}
+
+void UringBatchWriter::queue_chain(unsigned slot, int open_flags) {
+  Pending &pending = _slots[slot];
+  pending.ops_outstanding = 2 + pending.writes.size();
+
+  // Completions carry the slot, the op and which of the writes it was
+  auto user_data = [&](uint8_t opcode, uint32_t write) -> uint64_t {
+    return ((uint64_t)slot << 40) | ((uint64_t)write << 8) | opcode;
+  };
+
+  // Open straight into the direct descriptor slot (the index is 1-based)
+  struct io_uring_sqe *sqe = next_sqe();
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = reinterpret_cast<uint64_t>(pending.path.c_str());
+  sqe->len = 0644;
+  sqe->open_flags = open_flags;
+  sqe->file_index = slot + 1;
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = user_data(IORING_OP_OPENAT, 0);
+
+  // Write each range at its offset. Writes are hard linked, so that a failed
+  // write does not prevent the close from running.
+  for (size_t i = 0; i < pending.writes.size(); i++) {
+    const WriteRange &range = pending.writes[i];
+    sqe = next_sqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = slot;
+    sqe->off = range.offset;
+    sqe->addr = reinterpret_cast<uint64_t>(pending.data.data() + range.offset);
+    sqe->len = range.size;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+    sqe->user_data = user_data(IORING_OP_WRITE, i);
+  }
+
+  // Release the slot
+  sqe = next_sqe();
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->file_index = slot + 1;
+  sqe->user_data = user_data(IORING_OP_CLOSE, 0);
+}
+
+void UringBatchWriter::reap() {
+  unsigned head = *_cq_head;
+  const unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    const struct io_uring_cqe &cqe = _cqes[head & *_cq_mask];
+    const unsigned slot = cqe.user_data >> 40;
+    const uint32_t write = (cqe.user_data >> 8) & 0xFFFFFFFF;
+    const uint8_t opcode = cqe.user_data & 0xFF;
+    Pending &pending = _slots[slot];
+
+    // A short write leaves the rest of its range to be written once the
+    // chain has closed the file. Writing nothing at all would never finish.
+    if (opcode == IORING_OP_WRITE && cqe.res > 0) {
+      const WriteRange &range = pending.writes[write];
+      if ((size_t)cqe.res < range.size) {
+        pending.remaining.push_back(
+            WriteRange{range.offset + cqe.res, range.size - cqe.res});
+      }
+    }
+
+    // Report the first failure in each chain. If the open failed, the rest of
+    // the chain is cancelled.
+    const bool no_progress = opcode == IORING_OP_WRITE && cqe.res == 0;
+    if (!pending.failed && (cqe.res < 0 || no_progress)) {
+      pending.failed = true;
+      const char *what = opcode == IORING_OP_OPENAT  ? "open"
+                         : opcode == IORING_OP_WRITE ? "write"
+                                                     : "close";
+      fprintf(stderr, "Failed to %s '%s' - %s\n", what, pending.path.c_str(),
+              no_progress ? "short write" : strerror(-cqe.res));
+    }
+
+    if (--pending.ops_outstanding > 0) {
+      continue;
+    }
+
+    // Once the whole chain is done, either resume its short writes or reuse
+    // the slot
+    if (!pending.failed && !pending.remaining.empty()) {
+      pending.writes.swap(pending.remaining);
+      pending.remaining.clear();
+      _short_slots.push_back(slot);
+      continue;
+    }
+    _failed |= pending.failed;
+    pending.path.clear();
+    pending.writes.clear();
+    pending.remaining.clear();
+    _free_slots.push_back(slot);
+    _in_flight--;
+  }
+  __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+}
+
+bool UringBatchWriter::resume_short_writes() {
+  // Reopen each file without truncating it and write what is left. A resumed
+  // chain is never longer than the one it came from, so it always fits once
+  // the ring has been drained.
+  for (const unsigned slot : _short_slots) {
+    if (sq_space() < 2 + _slots[slot].writes.size() && !submit_and_wait(0)) {
+      return false;
+    }
+    queue_chain(slot, O_WRONLY);
+  }
+  _short_slots.clear();
+  return true;
+}
+
+void UringBatchWriter::write_file(const std::string &path,
+                                  const std::string_view &data) {
+  const size_t chunk_count =
+      data.empty() ? 0 : (data.size() + MAX_WRITE_CHUNK - 1) / MAX_WRITE_CHUNK;
+  const unsigned ops_needed = 2 + chunk_count;
+
+  // Files too large for a single chain are just written synchronously
+  if (ops_needed > _sq_entries) {
+    _failed |= !mg::fs::write_file(path.c_str(), data);
+    return;
+  }
+
+  // Chains are only submitted when the ring is full or a slot is needed, so
+  // that one io_uring_enter covers as many files as possible. A chain must be
+  // submitted in one go, so first make room for the whole of it.
+  reap();
+  while (_free_slots.empty() || sq_space() < ops_needed) {
+    if (!resume_short_writes() ||
+        !submit_and_wait(_free_slots.empty() ? 1 : 0)) {
+      _failed = true;
+      return;
+    }
+    reap();
+  }
+
+  const unsigned slot = _free_slots.back();
+  _free_slots.pop_back();
+  _in_flight++;
+  Pending &pending = _slots[slot];
+  pending.path = path;
+  pending.data = data;
+  pending.failed = false;
+  for (size_t i = 0; i < chunk_count; i++) {
+    const size_t offset = i * MAX_WRITE_CHUNK;
+    pending.writes.push_back(
+        WriteRange{offset, std::min(MAX_WRITE_CHUNK, data.size() - offset)});
+  }
+  queue_chain(slot, O_WRONLY | O_CREAT | O_TRUNC);
+}
+
+bool UringBatchWriter::flush() {
+  MG_TRACE_SCOPE(TRACE_WRITE, "BatchWriter::flush");
+  while (_in_flight > 0) {
+    if (!resume_short_writes() || !submit_and_wait(1)) {
+      _failed = true;
+      break;
+    }
+    reap();
+  }
+
+  const bool ok = !_failed;
+  _failed = false;
+  return ok;
+}
+
+#endif // IORING_RSRC_REGISTER_SPARSE
+
+} // namespace
+
+std::unique_ptr<BatchWriter> BatchWriter::create(unsigned queue_depth) {
+#ifdef IORING_RSRC_REGISTER_SPARSE
+  // io_uring may be missing, too old, or blocked by a seccomp policy
+  if (getenv("MG_DISABLE_IO_URING") == nullptr) {
+    auto uring = UringBatchWriter::create(queue_depth);
+    if (uring != nullptr) {
+      return uring;
+    }
+  }
+#endif
+
+  return std::unique_ptr<BatchWriter>(new PoolBatchWriter(0));
+}
+
+} // namespace mg::fs
@@ -1,6 +1,10 @@
 #include <mg/util/fs.hpp>
+#include <mg/util/trace.hpp>
 
 #include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -9,9 +13,112 @@
 namespace mg {
 namespace fs {
 
-MappedFile::~MappedFile() { munmap(const_cast<uint8_t *>(_data), _size); }
+namespace {
+
+// Where and how an output file is written
+struct OutputTarget {
+  // The destination with any symlinks resolved, so that the link survives and
+  // its target is what gets replaced
+  std::string path;
+  // Write straight to `path` instead of through a temporary. Special files
+  // can't be renamed over, and a rename would split hardlinks or hand a file
+  // owned by someone else over to us.
+  bool in_place = false;
+  // Permissions for the temporary
+  mode_t mode = 0;
+};
+
+// The process umask, read without changing it. umask() can only be queried
+// by setting it, which would race with other threads creating files.
+mode_t current_umask() {
+  static const mode_t ret = []() {
+    mode_t mask = 022;
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status != nullptr) {
+      char line[256];
+      while (fgets(line, sizeof(line), status) != nullptr) {
+        unsigned value;
+        if (sscanf(line, "Umask: %o", &value) == 1) {
+          mask = value;
+          break;
+        }
+      }
+      fclose(status);
+    }
+    return mask;
+  }();
+  return ret;
+}
+
+OutputTarget output_target(const char *path) {
+  OutputTarget ret;
+  ret.path = path;
+
+  // Paths such as /dev/stdout name a descriptor rather than a file, and must
+  // be written through as given
+  const std::string_view path_view(path);
+  if (path_view.rfind("/dev/", 0) == 0 || path_view.rfind("/proc/", 0) == 0) {
+    ret.in_place = true;
+    return ret;
+  }
+
+  char resolved[PATH_MAX];
+  if (realpath(path, resolved) != nullptr) {
+    ret.path = resolved;
+  }
+
+  // New files get the permissions open() would have given them, replaced
+  // files keep their own
+  struct stat st;
+  if (::stat(ret.path.c_str(), &st) != 0) {
+    // open() would create the target of a dangling symlink, so do the same
+    struct stat link_st;
+    ret.in_place = ::lstat(path, &link_st) == 0 && S_ISLNK(link_st.st_mode);
+    ret.mode = 0666 & ~current_umask();
+    return ret;
+  }
+  ret.in_place = !S_ISREG(st.st_mode) || st.st_nlink > 1 ||
+                 st.st_uid != geteuid() || st.st_gid != getegid();
+  ret.mode = st.st_mode & 07777;
+  return ret;
+}
+
+// Create a temporary alongside the destination, so that rename is atomic.
+// Returns the fd, or -1 on failure.
+int create_temp(const OutputTarget &target, std::string &temp_path) {
+  temp_path = target.path + ".XXXXXX";
+  const int fd = mkstemp(temp_path.data());
+  if (fd == -1) {
+    fprintf(stderr, "Failed to create temporary for '%s' - %s\n",
+            target.path.c_str(), strerror(errno));
+    return -1;
+  }
+  if (fchmod(fd, target.mode) != 0) {
+    fprintf(stderr, "Failed to set mode of '%s' - %s\n", temp_path.c_str(),
+            strerror(errno));
+    close(fd);
+    unlink(temp_path.c_str());
+    return -1;
+  }
+  return fd;
+}
+
+} // namespace
+
+MappedFile::~MappedFile() {
+  if (_data != nullptr) {
+    munmap(const_cast<uint8_t *>(_data), _size);
+  }
+  if (_fd != -1) {
+    close(_fd);
+  }
+  if (_writable && !_finalized && !_temp_path.empty()) {
+    unlink(_temp_path.c_str());
+  }
+}
 
 std::unique_ptr<MappedFile> MappedFile::open(const char *filename) {
+  MG_TRACE_SCOPE(TRACE_READ, "MappedFile::open");
   int file_fd = ::open(filename, O_RDONLY);
   if (file_fd < 0) {
     return nullptr;
@@ -28,10 +135,15 @@ std::unique_ptr<MappedFile> MappedFile::open(const char *filename) {
     return nullptr;
   }
 
+  // Empty files can't be mapped, but are still valid
+  if (file_size == 0) {
+    return std::unique_ptr<MappedFile>(new MappedFile(nullptr, 0));
+  }
+
   void *mmapped_data =
       mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file_fd, 0);
 
-  if (mmapped_data == nullptr) {
+  if (mmapped_data == MAP_FAILED) {
     return nullptr;
   }
 
@@ -39,7 +151,114 @@ std::unique_ptr<MappedFile> MappedFile::open(const char *filename) {
       new MappedFile(reinterpret_cast<uint8_t *>(mmapped_data), file_size));
 }
 
+std::unique_ptr<MappedFile> MappedFile::create(const char *path,
+                                               size_t size) {
+  // Files that can't be renamed over are staged in anonymous memory, and
+  // written out through FileWriter by finalize()
+  const OutputTarget target = output_target(path);
+  if (target.in_place) {
+    void *mmapped_data = nullptr;
+    if (size > 0) {
+      mmapped_data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (mmapped_data == MAP_FAILED) {
+        fprintf(stderr, "Failed to map %lu bytes - %s\n", size,
+                strerror(errno));
+        return nullptr;
+      }
+    }
+    return std::unique_ptr<MappedFile>(
+        new MappedFile(reinterpret_cast<uint8_t *>(mmapped_data), size, -1,
+                       path, ""));
+  }
+
+  std::string temp_path;
+  const int fd = create_temp(target, temp_path);
+  if (fd == -1) {
+    return nullptr;
+  }
+
+  // Allocate real blocks where we can, so that running out of space is an
+  // error here rather than a SIGBUS later
+  if (size > 0 && fallocate(fd, 0, 0, size) != 0 &&
+      ftruncate(fd, size) != 0) {
+    fprintf(stderr, "Failed to size '%s' - %s\n", path, strerror(errno));
+    close(fd);
+    unlink(temp_path.c_str());
+    return nullptr;
+  }
+
+  void *mmapped_data = nullptr;
+  if (size > 0) {
+    mmapped_data =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mmapped_data == MAP_FAILED) {
+      fprintf(stderr, "Failed to map '%s' - %s\n", path, strerror(errno));
+      close(fd);
+      unlink(temp_path.c_str());
+      return nullptr;
+    }
+  }
+
+  return std::unique_ptr<MappedFile>(
+      new MappedFile(reinterpret_cast<uint8_t *>(mmapped_data), size, fd,
+                     target.path, temp_path));
+}
+
+bool MappedFile::sync() {
+  if (_fd == -1 || _data == nullptr) {
+    return true;
+  }
+  if (msync(const_cast<uint8_t *>(_data), _size, MS_SYNC) != 0) {
+    fprintf(stderr, "Failed to sync '%s' - %s\n", _path.c_str(),
+            strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool MappedFile::finalize(size_t final_size) {
+  MG_TRACE_SCOPE(TRACE_WRITE, "MappedFile::finalize");
+  if (!_writable || _finalized) {
+    return _finalized;
+  }
+  if (final_size > (size_t)_size) {
+    fprintf(stderr, "Final size %lu exceeds mapped size %ld\n", final_size,
+            _size);
+    return false;
+  }
+
+  // Anonymous staging memory just gets written out
+  if (_fd == -1) {
+    if (!write_file(_path.c_str(),
+                    std::string_view(reinterpret_cast<const char *>(_data),
+                                     final_size))) {
+      return false;
+    }
+    _finalized = true;
+    return true;
+  }
+
+  if (!sync()) {
+    return false;
+  }
+  if (final_size != (size_t)_size && ftruncate(_fd, final_size) != 0) {
+    fprintf(stderr, "Failed to truncate '%s' - %s\n", _path.c_str(),
+            strerror(errno));
+    return false;
+  }
+  if (rename(_temp_path.c_str(), _path.c_str()) != 0) {
+    fprintf(stderr, "Failed to rename '%s' to '%s' - %s\n",
+            _temp_path.c_str(), _path.c_str(), strerror(errno));
+    return false;
+  }
+  _finalized = true;
+
+  return true;
+}
+
 bool read_file(const char *path, std::string &out) {
+  MG_TRACE_SCOPE(TRACE_READ, "read_file");
   // Open file
   const int fd = open(path, O_RDONLY);
   if (fd == -1) {
@@ -48,18 +267,39 @@ bool read_file(const char *path, std::string &out) {
   }
   std::shared_ptr<void> _defer_close_fd(nullptr, [=](...) { close(fd); });
 
-  static const size_t read_blocksz = 4096;
-  char buffer[read_blocksz];
-  out.clear();
-  ssize_t bytes_read = 0;
-  do {
-    bytes_read = read(fd, buffer, read_blocksz);
+  // Presize the buffer when the size is known up front. Pipes and other
+  // special files report no useful size, so grow as data arrives instead.
+  // The extra byte lets a regular file hit EOF without growing.
+  static const size_t min_read_size = 64 * 1024;
+  struct stat st;
+  size_t buffer_size = min_read_size;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    buffer_size = st.st_size + 1;
+  }
+  out.resize(buffer_size);
+
+  // Read until EOF, since a short read does not mean the end of the data
+  size_t total_bytes_read = 0;
+  while (true) {
+    if (total_bytes_read == out.size()) {
+      out.resize(out.size() * 2);
+    }
+
+    const ssize_t bytes_read =
+        read(fd, &out[total_bytes_read], out.size() - total_bytes_read);
     if (bytes_read == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
       fprintf(stderr, "Failed to read '%s' - %s\n", path, strerror(errno));
       return false;
     }
-    out.append(buffer, bytes_read);
-  } while (bytes_read == read_blocksz);
+    if (bytes_read == 0) {
+      break;
+    }
+    total_bytes_read += bytes_read;
+  }
+  out.resize(total_bytes_read);
 
   return true;
 }
@@ -69,24 +309,184 @@ bool write_file(const char *path, const std::string &data) {
 }
 
 bool write_file(const char *path, const std::string_view &data) {
-  // Open file
-  const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  MG_TRACE_SCOPE(TRACE_WRITE, "write_file");
+  auto writer = FileWriter::open(path, data.size());
+  return writer != nullptr && writer->write(data) && writer->commit();
+}
+
+std::unique_ptr<FileWriter> FileWriter::open(const char *path,
+                                             uint64_t expected_size) {
+  // Files that can't be replaced by rename are truncated and written in
+  // place, as a plain open() would
+  const OutputTarget target = output_target(path);
+  if (target.in_place) {
+    const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+      fprintf(stderr, "Failed to open '%s' - %s\n", path, strerror(errno));
+      return nullptr;
+    }
+    return std::unique_ptr<FileWriter>(new FileWriter(path, "", fd, false));
+  }
+
+  std::string temp_path;
+  const int fd = create_temp(target, temp_path);
   if (fd == -1) {
-    fprintf(stderr, "Failed to open '%s' - %s\n", path, strerror(errno));
-    return false;
+    return nullptr;
   }
-  std::shared_ptr<void> _defer_close_fd(nullptr, [=](...) { close(fd); });
 
+  // Reserve the space up front to avoid fragmenting large outputs. Not all
+  // filesystems support this, which is fine.
+  bool preallocated = false;
+  if (expected_size > 0) {
+    preallocated = fallocate(fd, 0, 0, expected_size) == 0;
+  }
+
+  return std::unique_ptr<FileWriter>(
+      new FileWriter(target.path, temp_path, fd, preallocated));
+}
+
+FileWriter::~FileWriter() {
+  if (_fd != -1) {
+    close(_fd);
+  }
+  if (!_committed && !_temp_path.empty()) {
+    unlink(_temp_path.c_str());
+  }
+}
+
+bool FileWriter::write_direct(const char *data, size_t size) {
   size_t total_bytes_written = 0;
-  do {
-    int wrote_bytes = write(fd, &data[total_bytes_written],
-                            data.size() - total_bytes_written);
+  while (total_bytes_written < size) {
+    const ssize_t wrote_bytes =
+        ::write(_fd, data + total_bytes_written, size - total_bytes_written);
     if (wrote_bytes == -1) {
-      fprintf(stderr, "Failed to write '%s' - %s\n", path, strerror(errno));
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Failed to write '%s' - %s\n", _path.c_str(),
+              strerror(errno));
       return false;
     }
     total_bytes_written += wrote_bytes;
-  } while (total_bytes_written < data.size());
+  }
+  return true;
+}
+
+bool FileWriter::write(const std::string_view &data) {
+  // Large writes skip the buffer entirely
+  if (data.size() >= BLOCK_SIZE) {
+    return flush() && write_direct(data.data(), data.size());
+  }
+
+  if (_buffer.size() + data.size() > BLOCK_SIZE && !flush()) {
+    return false;
+  }
+  if (_buffer.capacity() < BLOCK_SIZE) {
+    _buffer.reserve(BLOCK_SIZE);
+  }
+  _buffer.append(data);
+  return true;
+}
+
+bool FileWriter::flush() {
+  if (_buffer.empty()) {
+    return true;
+  }
+  const bool ok = write_direct(_buffer.data(), _buffer.size());
+  _buffer.clear();
+  return ok;
+}
+
+bool FileWriter::commit(bool sync) {
+  MG_TRACE_SCOPE(TRACE_WRITE, "FileWriter::commit");
+  if (!flush()) {
+    return false;
+  }
+
+  // Drop any preallocated space we didn't end up using
+  if (_preallocated) {
+    const off_t end = lseek(_fd, 0, SEEK_CUR);
+    if (end < 0 || ftruncate(_fd, end) != 0) {
+      fprintf(stderr, "Failed to truncate '%s' - %s\n", _path.c_str(),
+              strerror(errno));
+      return false;
+    }
+  }
+
+  if (sync && fdatasync(_fd) != 0) {
+    fprintf(stderr, "Failed to sync '%s' - %s\n", _path.c_str(),
+            strerror(errno));
+    return false;
+  }
+
+  if (close(_fd) != 0) {
+    _fd = -1;
+    fprintf(stderr, "Failed to close '%s' - %s\n", _path.c_str(),
+            strerror(errno));
+    return false;
+  }
+  _fd = -1;
+
+  // Special files were written in place
+  if (_temp_path.empty()) {
+    _committed = true;
+    return true;
+  }
+
+  if (rename(_temp_path.c_str(), _path.c_str()) != 0) {
+    fprintf(stderr, "Failed to rename '%s' to '%s' - %s\n",
+            _temp_path.c_str(), _path.c_str(), strerror(errno));
+    return false;
+  }
+  _committed = true;
+
+  // Make the rename itself durable
+  if (sync) {
+    std::string dir = _path;
+    const auto slash = dir.rfind('/');
+    dir = slash == std::string::npos ? "." : dir.substr(0, slash + 1);
+    const int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd != -1) {
+      fsync(dir_fd);
+      close(dir_fd);
+    }
+  }
+
+  return true;
+}
+
+bool writev_all(int fd, struct iovec *iov, size_t iovcnt) {
+  while (iovcnt > 0) {
+    // Skip any buffers that are already fully written
+    if (iov->iov_len == 0) {
+      iov++;
+      iovcnt--;
+      continue;
+    }
+
+    const int batch = iovcnt < IOV_MAX ? iovcnt : IOV_MAX;
+    ssize_t wrote_bytes = ::writev(fd, iov, batch);
+    if (wrote_bytes == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Failed to write - %s\n", strerror(errno));
+      return false;
+    }
+
+    // Advance past whatever was written
+    while (wrote_bytes > 0) {
+      const size_t consumed =
+          (size_t)wrote_bytes < iov->iov_len ? wrote_bytes : iov->iov_len;
+      iov->iov_base = reinterpret_cast<uint8_t *>(iov->iov_base) + consumed;
+      iov->iov_len -= consumed;
+      wrote_bytes -= consumed;
+      if (iov->iov_len == 0) {
+        iov++;
+        iovcnt--;
+      }
+    }
+  }
 
   return true;
 }
@@ -0,0 +1,337 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <mg/util/json.hpp>
+
+namespace mg::json {
+
+namespace {
+
+// Length of the UTF-8 sequence starting at `in[pos]`, or 0 if it is invalid
+// (truncated, overlong, surrogate or out of range)
+size_t utf8_sequence_length(const std::string_view &in, size_t pos) {
+  const uint8_t lead = in[pos];
+  size_t len;
+  uint8_t min_second = 0x80;
+  uint8_t max_second = 0xBF;
+  if (lead < 0x80) {
+    return 1;
+  } else if (lead >= 0xC2 && lead <= 0xDF) {
+    len = 2;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    len = 3;
+    if (lead == 0xE0) {
+      min_second = 0xA0;
+    } else if (lead == 0xED) {
+      max_second = 0x9F;
+    }
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    len = 4;
+    if (lead == 0xF0) {
+      min_second = 0x90;
+    } else if (lead == 0xF4) {
+      max_second = 0x8F;
+    }
+  } else {
+    return 0;
+  }
+
+  if (in.size() - pos < len) {
+    return 0;
+  }
+  const uint8_t second = in[pos + 1];
+  if (second < min_second || second > max_second) {
+    return 0;
+  }
+  for (size_t i = 2; i < len; i++) {
+    const uint8_t c = in[pos + i];
+    if (c < 0x80 || c > 0xBF) {
+      return 0;
+    }
+  }
+  return len;
+}
+
+// Whether `in` is entirely valid UTF-8. Runs of ASCII are skipped 16 bytes at
+// a time.
+bool valid_utf8(const std::string_view &in) {
+  size_t pos = 0;
+  while (pos < in.size()) {
+#ifdef __SSE2__
+    if (in.size() - pos >= 16) {
+      const __m128i v =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(in.data() + pos));
+      const uint32_t non_ascii = _mm_movemask_epi8(v);
+      if (non_ascii == 0) {
+        pos += 16;
+        continue;
+      }
+      pos += __builtin_ctz(non_ascii);
+    }
+#endif
+    const size_t len = utf8_sequence_length(in, pos);
+    if (len == 0) {
+      return false;
+    }
+    pos += len;
+  }
+  return true;
+}
+
+// Position of the first '"', '\\' or control character at or after `pos`
+size_t find_string_special(const std::string_view &data, size_t pos) {
+  const char *const base = data.data();
+#ifdef __SSE2__
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i max_control = _mm_set1_epi8(0x1F);
+  for (; data.size() - pos >= 16; pos += 16) {
+    const __m128i v =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(base + pos));
+    // Unsigned v <= 0x1F, as max(v, 0x1F) == 0x1F
+    const __m128i control =
+        _mm_cmpeq_epi8(_mm_max_epu8(v, max_control), max_control);
+    const uint32_t mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                  _mm_cmpeq_epi8(v, backslash)),
+                     control));
+    if (mask) {
+      return pos + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; pos < data.size(); pos++) {
+    const uint8_t c = base[pos];
+    if (c == '"' || c == '\\' || c < 0x20) {
+      return pos;
+    }
+  }
+  return pos;
+}
+
+// Parse the 4 hex digits of a \u escape
+bool parse_hex4(const std::string_view &data, size_t pos, uint32_t &out) {
+  if (data.size() - pos < 4) {
+    return false;
+  }
+  out = 0;
+  for (size_t i = pos; i < pos + 4; i++) {
+    const char c = data[i];
+    out <<= 4;
+    if (c >= '0' && c <= '9') {
+      out |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      out |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      out |= c - 'A' + 10;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void append_utf8(uint32_t codepoint, std::string &out) {
+  if (codepoint < 0x80) {
+    out.push_back(codepoint);
+  } else if (codepoint < 0x800) {
+    out.push_back(0xC0 | (codepoint >> 6));
+    out.push_back(0x80 | (codepoint & 0x3F));
+  } else if (codepoint < 0x10000) {
+    out.push_back(0xE0 | (codepoint >> 12));
+    out.push_back(0x80 | ((codepoint >> 6) & 0x3F));
+    out.push_back(0x80 | (codepoint & 0x3F));
+  } else {
+    out.push_back(0xF0 | (codepoint >> 18));
+    out.push_back(0x80 | ((codepoint >> 12) & 0x3F));
+    out.push_back(0x80 | ((codepoint >> 6) & 0x3F));
+    out.push_back(0x80 | (codepoint & 0x3F));
+  }
+}
+
+} // namespace
+
+bool append_string(const std::string_view &in, std::string &out) {
+  out.push_back('"');
+
+  // Copy runs of plain characters in one go
+  size_t run_start = 0;
+  size_t pos = 0;
+  auto flush_run = [&]() {
+    out.append(in.data() + run_start, pos - run_start);
+  };
+  while (pos < in.size()) {
+    const uint8_t c = in[pos];
+    if (c >= 0x80) {
+      const size_t len = utf8_sequence_length(in, pos);
+      if (len == 0) {
+        return false;
+      }
+      pos += len;
+      continue;
+    }
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      pos++;
+      continue;
+    }
+
+    flush_run();
+    switch (c) {
+    case '"':
+      out.append("\\\"");
+      break;
+    case '\\':
+      out.append("\\\\");
+      break;
+    case '\b':
+      out.append("\\b");
+      break;
+    case '\f':
+      out.append("\\f");
+      break;
+    case '\n':
+      out.append("\\n");
+      break;
+    case '\r':
+      out.append("\\r");
+      break;
+    case '\t':
+      out.append("\\t");
+      break;
+    default: {
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out.append(escaped);
+    } break;
+    }
+    pos++;
+    run_start = pos;
+  }
+  flush_run();
+
+  out.push_back('"');
+  return true;
+}
+
+void skip_whitespace(const std::string_view &data, size_t &pos) {
+  while (pos < data.size() && (data[pos] == ' ' || data[pos] == '\n' ||
+                               data[pos] == '\r' || data[pos] == '\t')) {
+    pos++;
+  }
+}
+
+bool consume(const std::string_view &data, size_t &pos, char c) {
+  skip_whitespace(data, pos);
+  if (pos >= data.size() || data[pos] != c) {
+    return false;
+  }
+  pos++;
+  return true;
+}
+
+bool parse_string(const std::string_view &data, size_t &pos,
+                  mg::util::Arena &arena, std::string_view &out) {
+  if (!consume(data, pos, '"')) {
+    return false;
+  }
+
+  // Most strings have no escapes, and can be used in place
+  const size_t start = pos;
+  pos = find_string_special(data, pos);
+  if (pos >= data.size()) {
+    return false;
+  }
+  if (!valid_utf8(data.substr(start, pos - start))) {
+    return false;
+  }
+  if (data[pos] == '"') {
+    out = data.substr(start, pos - start);
+    pos++;
+    return true;
+  }
+
+  // Otherwise unescape into a scratch buffer, then copy to the arena
+  thread_local std::string unescaped;
+  unescaped.assign(data.data() + start, pos - start);
+  while (true) {
+    if (pos >= data.size() || (uint8_t)data[pos] < 0x20) {
+      return false;
+    }
+    if (data[pos] == '"') {
+      pos++;
+      break;
+    }
+
+    // Escape sequence
+    if (data.size() - pos < 2) {
+      return false;
+    }
+    switch (data[pos + 1]) {
+    case '"':
+      unescaped.push_back('"');
+      break;
+    case '\\':
+      unescaped.push_back('\\');
+      break;
+    case '/':
+      unescaped.push_back('/');
+      break;
+    case 'b':
+      unescaped.push_back('\b');
+      break;
+    case 'f':
+      unescaped.push_back('\f');
+      break;
+    case 'n':
+      unescaped.push_back('\n');
+      break;
+    case 'r':
+      unescaped.push_back('\r');
+      break;
+    case 't':
+      unescaped.push_back('\t');
+      break;
+    case 'u': {
+      uint32_t codepoint;
+      if (!parse_hex4(data, pos + 2, codepoint)) {
+        return false;
+      }
+      // Characters outside the BMP are written as a surrogate pair
+      if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+        uint32_t low;
+        if (data.size() - pos < 12 || data[pos + 6] != '\\' ||
+            data[pos + 7] != 'u' || !parse_hex4(data, pos + 8, low) ||
+            low < 0xDC00 || low > 0xDFFF) {
+          return false;
+        }
+        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+        pos += 6;
+      } else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) {
+        return false;
+      }
+      append_utf8(codepoint, unescaped);
+      pos += 4;
+    } break;
+    default:
+      return false;
+    }
+    pos += 2;
+
+    // Copy the next run of plain characters
+    const size_t run_start = pos;
+    pos = find_string_special(data, pos);
+    if (!valid_utf8(data.substr(run_start, pos - run_start))) {
+      return false;
+    }
+    unescaped.append(data.data() + run_start, pos - run_start);
+  }
+
+  out = arena.copy(unescaped);
+  return true;
+}
+
+} // namespace mg::json
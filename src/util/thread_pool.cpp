@@ -0,0 +1,118 @@
+#include <mg/util/thread_pool.hpp>
+
+namespace mg::util {
+
+// Identifies the pool and worker index of the current thread, if any
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local unsigned current_worker = 0;
+
+ThreadPool::ThreadPool(unsigned thread_count) {
+  if (thread_count == 0) {
+    thread_count = std::thread::hardware_concurrency();
+  }
+  if (thread_count == 0) {
+    thread_count = 1;
+  }
+
+  for (unsigned i = 0; i < thread_count; i++) {
+    _workers.emplace_back(std::make_unique<Worker>());
+  }
+  for (unsigned i = 0; i < thread_count; i++) {
+    _threads.emplace_back([this, i]() { run(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  wait_idle();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _work_available.notify_all();
+  for (auto &thread : _threads) {
+    thread.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  // Work submitted from one of our own workers stays local, anything else is
+  // spread round-robin
+  const unsigned index = current_pool == this
+                             ? current_worker
+                             : _next_worker++ % _workers.size();
+
+  // Count the task before it becomes visible, so that it can't finish before
+  // it has been counted
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending++;
+    _queued++;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_workers[index]->mutex);
+    _workers[index]->tasks.emplace_back(std::move(task));
+  }
+  _work_available.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _idle.wait(lock, [this]() { return _pending == 0; });
+}
+
+bool ThreadPool::pop_task(unsigned index, std::function<void()> &out) {
+  // Newest task from our own deque first
+  {
+    Worker &self = *_workers[index];
+    std::lock_guard<std::mutex> lock(self.mutex);
+    if (!self.tasks.empty()) {
+      out = std::move(self.tasks.back());
+      self.tasks.pop_back();
+      _queued--;
+      return true;
+    }
+  }
+
+  // Otherwise steal the oldest task from someone else
+  for (unsigned i = 1; i < _workers.size(); i++) {
+    Worker &victim = *_workers[(index + i) % _workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      out = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      _queued--;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::run(unsigned index) {
+  current_pool = this;
+  current_worker = index;
+
+  std::function<void()> task;
+  while (true) {
+    if (pop_task(index, task)) {
+      task();
+      task = nullptr;
+
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (--_pending == 0) {
+        _idle.notify_all();
+      }
+      continue;
+    }
+
+    // Nothing to do, sleep until there is
+    std::unique_lock<std::mutex> lock(_mutex);
+    _work_available.wait(lock,
+                         [this]() { return _queued > 0 || _stopping; });
+    if (_stopping && _queued == 0) {
+      return;
+    }
+  }
+}
+
+} // namespace mg::util
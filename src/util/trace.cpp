@@ -0,0 +1,314 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <mg/util/fs.hpp>
+#include <mg/util/json.hpp>
+#include <mg/util/string.hpp>
+#include <mg/util/trace.hpp>
+
+namespace mg::trace {
+
+const char *category_name(Category category) {
+  switch (category) {
+  case TRACE_TOOL:
+    return "tool";
+  case TRACE_READ:
+    return "read";
+  case TRACE_PARSE:
+    return "parse";
+  case TRACE_HASH:
+    return "hash";
+  case TRACE_DECODE:
+    return "decode";
+  case TRACE_ENCODE:
+    return "encode";
+  case TRACE_WRITE:
+    return "write";
+  default:
+    return "unknown";
+  }
+}
+
+#ifdef MG_TRACE_ALLOCATIONS
+
+namespace {
+
+thread_local AllocationCounts thread_counts;
+std::atomic<uint64_t> process_count{0};
+std::atomic<uint64_t> process_bytes{0};
+
+// Heap in use, by malloc_usable_size() so that frees can be subtracted
+std::atomic<uint64_t> live_bytes{0};
+std::atomic<uint64_t> peak_live_bytes{0};
+
+void count_allocation(size_t size, size_t usable_size) {
+  thread_counts.count++;
+  thread_counts.bytes += size;
+  process_count.fetch_add(1, std::memory_order_relaxed);
+  process_bytes.fetch_add(size, std::memory_order_relaxed);
+
+  const uint64_t live =
+      live_bytes.fetch_add(usable_size, std::memory_order_relaxed) +
+      usable_size;
+  uint64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !peak_live_bytes.compare_exchange_weak(
+                            peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+void count_free(size_t usable_size) {
+  live_bytes.fetch_sub(usable_size, std::memory_order_relaxed);
+}
+
+} // namespace
+
+AllocationCounts thread_allocations() { return thread_counts; }
+
+AllocationCounts process_allocations() {
+  return AllocationCounts{process_count.load(std::memory_order_relaxed),
+                          process_bytes.load(std::memory_order_relaxed)};
+}
+
+#endif
+
+#ifdef MG_TRACE_ENABLED
+
+namespace {
+
+struct Event {
+  Category category;
+  const char *name;
+  uint64_t start_ns;
+  uint64_t end_ns;
+  AllocationCounts allocations;
+};
+
+// Each thread appends to its own buffer. The buffers are owned by the
+// registry, so they outlive the threads that filled them.
+struct ThreadBuffer {
+  unsigned tid;
+  std::mutex mutex;
+  std::vector<Event> events;
+};
+
+struct Registry {
+  std::string path;
+  uint64_t start_ns;
+  std::mutex mutex;
+  std::vector<std::shared_ptr<ThreadBuffer>> threads;
+};
+
+Registry &registry() {
+  static Registry ret;
+  return ret;
+}
+
+ThreadBuffer &thread_buffer() {
+  thread_local std::shared_ptr<ThreadBuffer> buffer;
+  if (buffer == nullptr) {
+    buffer = std::make_shared<ThreadBuffer>();
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    buffer->tid = reg.threads.size() + 1;
+    reg.threads.push_back(buffer);
+  }
+  return *buffer;
+}
+
+// Peak resident set size, or 0 if it cannot be read
+uint64_t peak_rss_bytes() {
+  FILE *status = fopen("/proc/self/status", "r");
+  if (status == nullptr) {
+    return 0;
+  }
+  char line[256];
+  unsigned long peak_kb = 0;
+  while (fgets(line, sizeof(line), status) != nullptr) {
+    if (sscanf(line, "VmHWM: %lu kB", &peak_kb) == 1) {
+      break;
+    }
+  }
+  fclose(status);
+  return (uint64_t)peak_kb * 1024;
+}
+
+void dump() {
+  Registry &reg = registry();
+  std::vector<std::pair<unsigned, Event>> events;
+  {
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto &thread : reg.threads) {
+      std::lock_guard<std::mutex> thread_lock(thread->mutex);
+      for (auto &event : thread->events) {
+        events.emplace_back(thread->tid, event);
+      }
+    }
+  }
+
+  // Chrome trace format, complete ('X') events with microsecond times
+  std::string out = "{\"traceEvents\":[";
+  const int pid = getpid();
+  for (size_t i = 0; i < events.size(); i++) {
+    const auto &[tid, event] = events[i];
+    out += i == 0 ? "\n" : ",\n";
+    out += "{\"name\":";
+    mg::json::append_string(event.name, out);
+    out += mg::string::format(
+        ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,"
+        "\"tid\":%u}",
+        category_name(event.category),
+        (event.start_ns - reg.start_ns) / 1000.0,
+        (event.end_ns - event.start_ns) / 1000.0, pid, tid);
+#ifdef MG_TRACE_ALLOCATIONS
+    out.insert(out.size() - 1,
+               mg::string::format(
+                   ",\"args\":{\"allocations\":%lu,\"allocated_bytes\":%lu}",
+                   event.allocations.count, event.allocations.bytes));
+#endif
+  }
+  out += "\n]}\n";
+  if (!mg::fs::write_file(reg.path.c_str(), out)) {
+    fprintf(stderr, "Failed to write trace to '%s'\n", reg.path.c_str());
+  }
+
+  // Summary, slowest first. Like times, allocations include those of any
+  // spans nested inside on the same thread.
+  struct Totals {
+    Category category;
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    AllocationCounts allocations;
+  };
+  // Keyed by category too, as tools name their span after the function
+  // they wrap
+  std::map<std::pair<Category, std::string>, Totals> totals;
+  for (auto &[tid, event] : events) {
+    Totals &entry = totals[{event.category, event.name}];
+    const uint64_t duration = event.end_ns - event.start_ns;
+    entry.category = event.category;
+    entry.count++;
+    entry.total_ns += duration;
+    entry.max_ns = std::max(entry.max_ns, duration);
+    entry.allocations.count += event.allocations.count;
+    entry.allocations.bytes += event.allocations.bytes;
+  }
+  std::vector<std::pair<std::pair<Category, std::string>, Totals>> sorted(
+      totals.begin(), totals.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.total_ns > b.second.total_ns;
+  });
+#ifdef MG_TRACE_ALLOCATIONS
+  fprintf(stderr, "%-32s %-8s %8s %12s %12s %12s %12s\n", "span", "category",
+          "count", "total ms", "max ms", "allocs", "alloc MB");
+  for (auto &[key, entry] : sorted) {
+    fprintf(stderr, "%-32s %-8s %8lu %12.3f %12.3f %12lu %12.3f\n",
+            key.second.c_str(), category_name(entry.category), entry.count,
+            entry.total_ns / 1e6, entry.max_ns / 1e6, entry.allocations.count,
+            entry.allocations.bytes / 1e6);
+  }
+  const AllocationCounts process = process_allocations();
+  fprintf(stderr,
+          "peak RSS %.3f MB, peak heap %.3f MB, %lu allocations (%.3f MB)\n",
+          peak_rss_bytes() / 1e6, peak_live_bytes / 1e6, process.count,
+          process.bytes / 1e6);
+#else
+  fprintf(stderr, "%-32s %-8s %8s %12s %12s\n", "span", "category", "count",
+          "total ms", "max ms");
+  for (auto &[key, entry] : sorted) {
+    fprintf(stderr, "%-32s %-8s %8lu %12.3f %12.3f\n", key.second.c_str(),
+            category_name(entry.category), entry.count,
+            entry.total_ns / 1e6, entry.max_ns / 1e6);
+  }
+  fprintf(stderr, "peak RSS %.3f MB\n", peak_rss_bytes() / 1e6);
+#endif
+}
+
+bool start() {
+  const char *path = getenv("MG_TRACE");
+  if (path == nullptr || path[0] == '\0') {
+    return false;
+  }
+  Registry &reg = registry();
+  reg.path = path;
+  reg.start_ns = now_ns();
+  atexit(dump);
+  return true;
+}
+
+} // namespace
+
+bool active() {
+  static const bool ret = start();
+  return ret;
+}
+
+uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void record(Category category, const char *name, uint64_t start_ns,
+            uint64_t end_ns, AllocationCounts allocations) {
+#ifdef MG_TRACE_ALLOCATIONS
+  // The trace's own bookkeeping is not charged to the enclosing spans
+  const AllocationCounts saved_counts = thread_counts;
+#endif
+  ThreadBuffer &buffer = thread_buffer();
+  {
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back(
+        Event{category, name, start_ns, end_ns, allocations});
+  }
+#ifdef MG_TRACE_ALLOCATIONS
+  thread_counts = saved_counts;
+#endif
+}
+
+#endif
+
+} // namespace mg::trace
+
+#ifdef MG_TRACE_ALLOCATIONS
+
+// Replacing these is enough to see every allocation: the array and nothrow
+// forms are implemented on top of them. With optimization, GCC assumes
+// whatever reaches operator delete came from operator new, and warns about
+// the free() even though this operator new is malloc based.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void *operator new(size_t size) {
+  void *ret = malloc(size == 0 ? 1 : size);
+  if (ret == nullptr) {
+    throw std::bad_alloc();
+  }
+  mg::trace::count_allocation(size, malloc_usable_size(ret));
+  return ret;
+}
+
+void operator delete(void *ptr) noexcept {
+  if (ptr != nullptr) {
+    mg::trace::count_free(malloc_usable_size(ptr));
+  }
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+
+#pragma GCC diagnostic pop
+
+#endif